@@ -4,12 +4,20 @@
 // stl includes
 #include <fstream>
 #include <vector>
+#include <mutex>
 
 // local includes
 #include "Log.h"
+#include "AliasTable.h"
+#include "ScratchBuffer.h"
 
 // forward declarations
 class TTree;
+class EventCache;
+class HistDefs;
+class DecisionTree;
+class Forest;
+class Context;
 
 
 class Algorithm {
@@ -20,8 +28,8 @@ public:
   Algorithm();
   Algorithm(TTree * source, TTree * target);
 
-  // destructor
-  virtual ~Algorithm() {}
+  // destructor (deletes the event caches)
+  virtual ~Algorithm();
 
   // initialize algorithm
   virtual void Initialize() = 0;
@@ -29,11 +37,24 @@ public:
   // process algorithm
   virtual void Process() = 0;
 
+  // get normalization of the weights (sums over the events of all processes, so all processes have to call it; has to be
+  // called before Write())
+  void Normalize();
+
   // write weights to outout file
   virtual void Write(std::ofstream & outfile) = 0;
   
-  // get weight
-  virtual void GetWeight(float & weight, float & error) const = 0;
+  // get weight of current event (reads the variables from the Event buffers)
+  void GetWeight(float & weight, float & error) const;
+
+  // get weight (features in the same order as Variables::Get())
+  void GetWeight(const float * features, float & weight, float & error) const;
+
+  // get weights of a batch of events (features of event i start at features[i*Variables::Get().size()])
+  virtual void GetWeights(const float * features, long nEvents, float * weights, float * errors) const = 0;
+
+  // number of events evaluated together against all trees (size of the scratch space of GetWeights)
+  static const int BLOCKSIZE = 64;
 
   
 protected:
@@ -41,21 +62,58 @@ protected:
   // trees
   TTree * m_source;
   TTree * m_target;
+
+  // in-memory copies of the trees (read once, used for all training loops)
+  void FillCache();
+  EventCache * m_cacheSource;
+  EventCache * m_cacheTarget;
   
-  // indices to events to be used
-  void PrepareIndices();
-  std::vector<long> * m_indicesSource;
-  std::vector<long> * m_indicesTarget;
+  // fill the event indices of the context (random sub-sample drawn from the context's random number stream if bagging),
+  // or the multiplicities of all events for the Poisson bootstrap ('PoissonBagging')
+  void PrepareIndices(Context & context) const;
+
+  // alias tables of the event weights (for bagging)
+  AliasTable m_aliasSource;
+  AliasTable m_aliasTarget;
+
+  // sums of positive event weights of all processes, and the fractions of them in the shards of the processes up to
+  // (excluding/including) this one (for bagging)
+  double m_sumWeightsSource;
+  double m_sumWeightsTarget;
+  double m_shardFractionsSource[2];
+  double m_shardFractionsTarget[2];
+  void SumWeights(const EventCache * cache, double & sum, double * shardFractions) const;
+
+  // draw multiplicity of each event from a Poisson distribution with mean nDraws*weight/sumWeights
+  void DrawMultiplicities(const EventCache * cache, double sumWeights, long nDraws, Philox & random, std::vector<unsigned char> & multiplicities) const;
+
+  // get mean and standard deviation of the weights of all trees of all forests for a batch of events (RandomForest and
+  // ExtraTrees)
+  void AverageTrees(const std::vector<const Forest *> & forests, const float * features, long nEvents, float * weights, float * errors) const;
+
+  // grow tree number context.TreeIndex() in the given context (nThreads is the number of threads used for filling its nodes)
+  virtual DecisionTree * GrowTree(Context & context, int nThreads) = 0;
+
+  // grow independent trees and add them to the forest in order (on a pool of worker threads if 'ParallelTrees' is enabled);
+  // each tree has its own context, whose histograms are passed to HistService afterwards
+  void GrowForest(Forest * forest, int ntree, const HistDefs * histDefs);
   
   // helper functions
-  int BinarySearchIndex(const std::vector<float> & cDist , float cVal, int l, int r) const;
   float GetNormalization() const;
+
+  // normalization of the weights (set by Normalize(), checked by Normalization())
+  float m_normalization;
+  float Normalization() const;
   
-  // event weights
-  std::vector<float> m_weights;
+  // event weights (kept in a scratch file if there is a 'MemoryBudget')
+  ScratchBuffer m_weights;
+
+  // buffer for the variables of the current event
+  mutable std::vector<float> m_features;
 
-  // log
+  // log (logging from code which runs on the worker threads of GrowForest has to hold m_logMutex)
   mutable Log m_log;
+  mutable std::mutex m_logMutex;
   
 };
 
@@ -0,0 +1,53 @@
+#ifndef __ALIASTABLE__
+#define __ALIASTABLE__
+
+// stl includes
+#include <vector>
+#include <cstdint>
+
+// local includes
+#include "Log.h"
+#include "Philox.h"
+
+
+// Walker alias table: draws event indices with probability proportional to the event weights in O(1) per draw
+class AliasTable {
+
+public:
+
+  // constructor (empty table)
+  AliasTable();
+
+  // destructor
+  ~AliasTable() {}
+
+  // build table from the weights of n events (negative weights are treated as zero)
+  void Build(const float * weights, unsigned long n);
+
+  // check if table was built
+  bool Empty() const { return m_probability.empty(); }
+
+  // draw one index
+  long Draw(Philox & random) const
+  {
+    long index = static_cast<long>( (static_cast<uint64_t>(random.Next()) * m_probability.size()) >> 32 );
+    return random.Rndm() < m_probability[index] ? index : m_alias[index];
+  }
+
+  // draw n indices, returned in ascending order (so duplicate indices are adjacent)
+  void DrawSorted(long n, Philox & random, std::vector<long> & indices) const;
+
+
+private:
+
+  // probability to keep the index of each bucket, and the alias drawn otherwise
+  std::vector<float> m_probability;
+  std::vector<unsigned int> m_alias;
+
+  // logger
+  mutable Log m_log;
+
+};
+
+
+#endif
@@ -11,7 +11,9 @@
 
 // forward declarations
 class Forest;
+class DecisionTree;
 class HistDefs;
+class Context;
 class TTree;
 
 
@@ -35,15 +37,21 @@ public:
   // write weights to outout file
   virtual void Write(std::ofstream & outfile);
 
-  // get weight
-  virtual void GetWeight(float & weight, float & error) const;
+  // get weights of a batch of events
+  virtual void GetWeights(const float * features, long nEvents, float * weights, float * errors) const;
 
     
 private:
 
+  // grow a single tree (updates the event weights used by the next tree)
+  virtual DecisionTree * GrowTree(Context & context, int nThreads);
+
   // histogram definitions
   HistDefs * m_histDefs;
 
+  // training context (shared by all trees, since they are grown one after the other)
+  Context * m_context;
+
   // forest(s)
   std::vector<const Forest *> m_forests;
 
@@ -5,11 +5,11 @@
 #include <string>
 
 // local includes
-#include "Log.h"
 #include "Variable.h"
 
 // forward declarations
 class Node;
+class EventCache;
 
 
 class Branch {
@@ -18,74 +18,54 @@ public:
 
 
   //
-  // base class to hold cut
+  // cut on a single variable (held by value, see Pass for the convention)
   //
   class Cut {
 
   public:
 
     // constructor
-    Cut(const Variable * variable, float cutValue) : m_variable(variable), m_cutValue(cutValue) {}
+    Cut(const Variable * variable, float cutValue, bool isGreater, int cutBin = -1) : m_variable(variable), m_cutValue(cutValue), m_cutBin(cutBin), m_isGreater(isGreater) {}
 
-    // destructor
-    virtual ~Cut() {}
+    // pass cut (features in the same order as Variables::Get())
+    bool Pass(const float * features) const { return (features[m_variable->Index()] >= m_cutValue) == m_isGreater; }
 
-    // pass cut
-    virtual bool Pass() const = 0;
+    // pass cut (cached event, using bin indices)
+    bool Pass(const EventCache * cache, long ievent) const;
 
     // get variable
     const Variable * GetVariable() const { return m_variable; }
 
     // get cutValue
     float CutValue() const { return m_cutValue; }
+
+    // get first bin above the cut (-1 if not known, e.g. when read from file)
+    int CutBin() const { return m_cutBin; }
+
+    // check if this is the greater-than side of the cut
+    bool IsGreater() const { return m_isGreater; }
     
     
-  protected:
+  private:
     
     // variable info
     const Variable * m_variable;
-    const float m_cutValue;
-    
-  };
-
-  
-  //
-  // greater-than cut
-  //
-  class Greater : public Cut {
-
-  public:
-
-    // constructor
-    Greater(const Variable * variable, float cutValue) : Cut(variable, cutValue) {}
-
-    // pass cut implementation
-    bool Pass() const { return m_variable->Value() >= m_cutValue; }
-    
-  };
-
-
-  //
-  // smaller-than cut
-  //
-  class Smaller : public Cut {
-    
-  public:
-
-    // constructor
-    Smaller(const Variable * variable, float cutValue) : Cut(variable, cutValue) {}
-
-    // pass cut implementation
-    bool Pass() const { return m_variable->Value() < m_cutValue; }
+    float m_cutValue;
+    int m_cutBin;
+    bool m_isGreater;
     
   };
 
   
   // constructor
-  Branch(Node * input, const std::string & variableName, float cutValue, bool isGreater, float sumSource, float sumTarget);
+  Branch(Node * input, const Variable * variable, float cutValue, bool isGreater, float sumSource, float sumTarget, int cutBin = -1);
 
   // destructor
-  ~Branch();
+  ~Branch() {}
+
+  // not copyable (nodes point to their branches)
+  Branch(const Branch &) = delete;
+  Branch & operator=(const Branch &) = delete;
 
   // get input node
   const Node * InputNode () const;
@@ -100,10 +80,14 @@ public:
   const std::string & VariableName() const ;
 
   // selection
-  bool Pass() const;
+  bool Pass(const float * features) const;
+  bool Pass(const EventCache * cache, long ievent) const;
 
   // get cut
-  const Cut * CutObject() const;
+  const Cut & CutObject() const;
+
+  // check if this is the branch above the cut
+  bool IsGreater() const;
 
   // get sum of events source
   float SumSource() const;
@@ -119,14 +103,11 @@ private:
   const Node * m_output;
   
   // cut object
-  const Cut * m_cut;
+  const Cut m_cut;
 
   // sum of events
   const float m_sumSource;
   const float m_sumTarget;
-  
-  // logger
-  mutable Log m_log;
 
 };
 
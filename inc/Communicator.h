@@ -0,0 +1,106 @@
+#ifndef __COMMUNICATOR__
+#define __COMMUNICATOR__
+
+// local includes
+#include "Log.h"
+
+// stl includes
+#include <vector>
+
+
+// Worker processes for parallel training. Data-parallel: each process caches a shard of the source/target events, and the
+// processes add up their node histograms (and other sums over events) layer by layer. Feature-parallel: each process
+// caches all events, but only fills and scores the histograms of its own variables, and the processes exchange the best
+// split of each node. The first process collects the values of all processes and combines them in rank order, so all
+// processes get bit-identical results and thus choose the same splits. Messages go over stream sockets (Unix-domain
+// socket pairs between the first process and each worker).
+class Communicator {
+
+public:
+
+  // how the work is split between the processes
+  enum MODE {
+    DATA_PARALLEL,
+    FEATURE_PARALLEL
+  };
+
+  // operation used to combine values of the processes
+  enum OPERATION {
+    SUM,
+    MIN,
+    MAX
+  };
+
+  // singleton pattern
+  static Communicator & Instance()
+  {
+    static Communicator instance;
+    return instance;
+  }
+
+  // disable copy-constructor and assignment operator
+  Communicator(const Communicator & other) = delete;
+  void operator=(const Communicator & other) = delete;
+
+  // fork nProcesses - 1 worker processes (returns in every process; has to be called before any file is opened or thread
+  // is started)
+  void Start(int nProcesses, MODE mode = DATA_PARALLEL);
+
+  // wait for the worker processes to finish (first process), or close the connection (workers)
+  void Finish();
+
+  // get rank of this process (0 for the first process) and number of processes
+  int Rank() const { return m_rank; }
+  int Size() const { return m_size; }
+
+  // check if the processes split the variables between them
+  bool FeatureParallel() const { return m_size > 1 && m_mode == FEATURE_PARALLEL; }
+
+  // get number of event shards and the shard of this process (data-parallel, otherwise each process has all events)
+  int NumberOfShards() const { return FeatureParallel() ? 1 : m_size; }
+  int ShardIndex() const { return FeatureParallel() ? 0 : m_rank; }
+
+  // get shard [first, last) of nEntries entries owned by this process
+  void Shard(long nEntries, long & first, long & last) const;
+
+  // check if this process fills and scores the histograms of a variable (ivar is the position in Variables::Get())
+  bool OwnsVariable(unsigned int ivar) const { return ! FeatureParallel() || static_cast<int>(ivar % m_size) == m_rank; }
+
+  // combine n values of all processes element by element (has to be called by all processes in the same order)
+  void AllReduce(double * data, unsigned long n, OPERATION operation = SUM);
+  double AllReduce(double value, OPERATION operation = SUM);
+
+  // combine n values of all event shards (sums over events, nothing is done if each process has all events)
+  void AllReduceShards(double * data, unsigned long n, OPERATION operation = SUM);
+
+
+private:
+
+  // constructor (single process)
+  Communicator();
+
+  // send/receive n values over a socket
+  void Send(int fd, const double * data, unsigned long n) const;
+  void Receive(int fd, double * data, unsigned long n) const;
+
+  // rank and number of processes, and how the work is split
+  int m_rank;
+  int m_size;
+  MODE m_mode;
+
+  // sockets (first process: one per worker, in order of rank; worker: one to the first process)
+  std::vector<int> m_sockets;
+
+  // process ids of the workers (first process)
+  std::vector<int> m_workers;
+
+  // receive buffer (first process)
+  std::vector<double> m_buffer;
+
+  // logger
+  mutable Log m_log;
+
+};
+
+
+#endif
@@ -6,6 +6,7 @@
 
 // local includes
 #include "Log.h"
+#include "FieldHandle.h"
 
 // forward declarations
 class Store;
@@ -36,6 +37,10 @@ public:
   template <typename T>
   bool getif(const std::string & name, T & value) const;
 
+  // get typed handle to variable (for repeated access, the value must not be modified)
+  template <typename T>
+  FieldHandle<T> handle(const std::string & name) const;
+
   // write to file
   void write(std::ofstream & file) const;
 
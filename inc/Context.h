@@ -0,0 +1,100 @@
+#ifndef __CONTEXT__
+#define __CONTEXT__
+
+// stl includes
+#include <string>
+#include <vector>
+#include <map>
+
+// local includes
+#include "Log.h"
+#include "Philox.h"
+
+// forward declarations
+class EventCache;
+class HistDefs;
+class TH1F;
+
+
+// State of one training task (e.g. growing one tree). The context owns everything the task modifies (event indices of the
+// sub-sample, histograms filled by the task), hands out the random number streams of the tree, and points to the read-only
+// event caches and histogram definitions, which are shared by all tasks. Tasks running on different threads each have
+// their own context.
+class Context {
+
+public:
+
+  // constructor
+  Context(const EventCache * source, const EventCache * target, const HistDefs * histDefs, unsigned int seed);
+
+  // disable copy-constructor and assignment operator
+  Context(const Context & other) = delete;
+  void operator=(const Context & other) = delete;
+
+  // destructor (deletes histograms which were not taken)
+  ~Context();
+
+  // get cached source/target events and histogram definitions
+  const EventCache * Source() const { return m_source; }
+  const EventCache * Target() const { return m_target; }
+  const HistDefs * GetHistDefs() const { return m_histDefs; }
+
+  // get event indices of the sub-sample (filled by Algorithm::PrepareIndices)
+  std::vector<long> & IndicesSource() { return m_indicesSource; }
+  std::vector<long> & IndicesTarget() { return m_indicesTarget; }
+  const std::vector<long> & IndicesSource() const { return m_indicesSource; }
+  const std::vector<long> & IndicesTarget() const { return m_indicesTarget; }
+
+  // get multiplicity of every event (Poisson bootstrap, filled by Algorithm::PrepareIndices instead of the event indices)
+  std::vector<unsigned char> & MultiplicitySource() { return m_multiplicitySource; }
+  std::vector<unsigned char> & MultiplicityTarget() { return m_multiplicityTarget; }
+  const std::vector<unsigned char> & MultiplicitySource() const { return m_multiplicitySource; }
+  const std::vector<unsigned char> & MultiplicityTarget() const { return m_multiplicityTarget; }
+
+  // get random number stream of a node of the current tree (node 0 for streams of the whole tree, e.g. bagging)
+  Philox Stream(unsigned long long node, Philox::PURPOSE purpose) const { return Philox(m_seed, m_treeIndex, node, purpose); }
+
+  // set/get index of the tree grown in this context
+  void SetTreeIndex(int itree) { m_treeIndex = itree; }
+  int TreeIndex() const { return m_treeIndex; }
+
+  // add histogram (not attached to any directory)
+  TH1F * AddHist(const std::string & name, int nbins, float xmin, float xmax);
+
+  // get histogram
+  TH1F * GetHist(const std::string & name) const;
+
+  // take ownership of the histograms (in the order they were added), e.g. to pass them to HistService from the main thread
+  std::vector<TH1F *> TakeHists();
+
+
+private:
+
+  // shared read-only inputs
+  const EventCache * m_source;
+  const EventCache * m_target;
+  const HistDefs * m_histDefs;
+
+  // event indices, or multiplicities of all events
+  std::vector<long> m_indicesSource;
+  std::vector<long> m_indicesTarget;
+  std::vector<unsigned char> m_multiplicitySource;
+  std::vector<unsigned char> m_multiplicityTarget;
+
+  // seed of the random number streams
+  unsigned int m_seed;
+
+  // tree index
+  int m_treeIndex;
+
+  // histograms (in order, and by name)
+  std::vector<TH1F *> m_hists;
+  std::map<std::string, TH1F *> m_histMap;
+
+  // logger
+  mutable Log m_log;
+
+};
+
+
+#endif
@@ -3,17 +3,20 @@
 
 // stl includes
 #include <vector>
+#include <deque>
 #include <utility>
 #include <fstream>
 
 // local includes
 #include "Log.h"
 #include "Branch.h"
+#include "Node.h"
+#include "ScratchBuffer.h"
 
 // forward declarations
-class Node;
 class HistDefs;
-class TTree;
+class EventCache;
+class Context;
 
 
 class DecisionTree {
@@ -26,41 +29,100 @@ public:
     TARGET    
   };
 
-  // constructor (calculate weights)
-  DecisionTree(TTree * source, TTree * target, const std::vector<long> * indicesSource, const std::vector<long> * indicesTarget, const HistDefs * histDefs);
+  // flat node (depth-first order, starting at the first node): holds the variable index, the cut value, the first bin
+  // above the cut, and the positions of the output nodes below/above the cut (final nodes are encoded as ~position in
+  // the array of weights)
+  struct FlatNode {
+    unsigned int variable;
+    float cutValue;
+    int cutBin;
+    int output[2];
+  };
+
+  // constructor (calculate weights, the context provides the samples, event indices, histogram definitions and random
+  // number stream, and has to outlive GrowTree())
+  DecisionTree(Context & context);
 
   // constructor (apply weights)
-  DecisionTree(const std::vector<std::pair<float, std::vector<const Branch::Cut *> > > & tree);
+  DecisionTree(const std::vector<std::pair<float, std::vector<Branch::Cut> > > & tree);
+
+  // constructor (apply weights, from flat arrays which are not copied and have to outlive the tree, e.g. a memory-mapped file)
+  DecisionTree(const FlatNode * nodes, unsigned int nNodes, const float * weights, unsigned int nWeights);
 
   // destructor
   ~DecisionTree();
 
-  // grow tree
-  void GrowTree(std::vector<float> * weights = 0);
+  // set number of threads used for filling nodes (default is 'NumberOfThreads')
+  void SetNumberOfThreads(int nThreads);
+
+  // grow tree (the per-event state is kept in scratch files if there is a 'MemoryBudget', and the events are processed
+  // chunk by chunk)
+  void GrowTree(ScratchBuffer * weights = 0);
 
   // finalize weights on final nodes
   void FinalizeWeights();
 
-  // get weight
-  float GetWeight() const;
+  // get weight of event (features in the same order as Variables::Get())
+  float GetWeight(const float * features) const;
+
+  // get weights of a batch of events (features of event i start at features[i*nVariables])
+  void GetWeights(const float * features, unsigned int nVariables, int nEvents, float * weights) const;
+
+  // get weight of cached event (only for trees grown on the cache, since it uses the bin indices)
+  float GetWeight(const EventCache * cache, long ievent) const;
+
+  // compiled evaluation function of a tree (generated by CompileForest)
+  typedef float (*Function)(const float * features);
+
+  // evaluate with a compiled function instead of the flat arrays (the function has to be generated from this tree; only
+  // changes how the tree is evaluated, so it can be set on trees of const forests)
+  void SetFunction(Function function) const;
+
+  // get flat arrays
+  const FlatNode * FlatNodes() const { return m_nodeArray; }
+  unsigned int NumberOfFlatNodes() const { return m_nNodeArray; }
+  const float * FlatWeights() const { return m_weightArray; }
+  unsigned int NumberOfFlatWeights() const { return m_nWeightArray; }
 
   // print tree
   void Print(const std::string & prefix, Log::LEVEL level) const;
 
-  // write to file
-  void Write(std::ofstream & file, float normalization = 1) const;
+  // write to file (itree is the position of the tree in the forest; not possible for trees read from flat arrays)
+  void Write(std::ofstream & file, int itree, float normalization = 1) const;
 
   
 private:
   
-  // fill nodes
-  void FillNodes(std::vector<Node *> layer, INPUT input,  std::vector<float> * MLWeights = 0) const;
+  // fill nodes (null nodes in the layer are not filled)
+  void FillNodes(const std::vector<Node *> & layer, const ScratchBuffer & nodeIndices, INPUT input, const ScratchBuffer * MLWeights = 0) const;
+
+  // fill nodes using several threads (each thread fills private histograms, which are added to the nodes at the end)
+  void FillNodesThreaded(const std::vector<Node *> & layer, const ScratchBuffer & nodeIndices, INPUT input, const ScratchBuffer * MLWeights, int nThreads) const;
+
+  // replace the split of each node by the best split of all processes (feature-parallel, the summaries are replaced)
+  void ExchangeSplits(std::vector<Node::Summary *> & splits) const;
+
+  // move events from the nodes of a layer to the nodes of the next layer
+  void UpdateNodeIndices(const std::vector<Node *> & layer, const std::vector<int> & nextLow, const std::vector<int> & nextHigh, ScratchBuffer & nodeIndices, INPUT input) const;
 
   // update ML weights
-  void UpdateWeights(std::vector<float> * MLWeights) const;
+  void UpdateWeights(ScratchBuffer * MLWeights) const;
+
+  // drop the per-event data of the events at positions [first, last) of the sub-sample from memory (out-of-core training)
+  void ReleaseEvents(INPUT input, long first, long last, const ScratchBuffer * nodeIndices, const ScratchBuffer * MLWeights) const;
 
-  // create new node
-  void CreateNode(Branch * input, std::vector<Node *> & nextLayer);
+  // print tree from the flat arrays (trees read from a binary weights file have no nodes)
+  void PrintFlat(const std::string & prefix, Log::LEVEL level) const;
+
+  // create new node (returns true if it is added to the next layer)
+  bool CreateNode(Branch * input, std::vector<Node *> & nextLayer);
+
+  // convert tree to flat arrays used for evaluation (done when the tree is grown or read from file)
+  void Compile();
+  int CompileNode(const Node * node);
+
+  // create node in the node storage
+  Node * NewNode(Branch * input);
 
   // add node to decision tree
   void AddNodeToTree(const Node * node);
@@ -69,18 +131,53 @@ private:
   const Node * FirstNode() const; 
   const std::vector<const Node *> FinalNodes() const;
 
-  // TTrees for initial and target samples, and event indices for Random Forest
-  TTree * m_source;
-  TTree * m_target;
+  // cached initial and target samples, and event indices or multiplicities (Poisson bootstrap) of the sub-samples
+  const EventCache * m_source;
+  const EventCache * m_target;
   const std::vector<long> * m_indicesSource;
   const std::vector<long> * m_indicesTarget;
+  const std::vector<unsigned char> * m_multiplicitySource;
+  const std::vector<unsigned char> * m_multiplicityTarget;
+
+  // get cached events, and event indices or multiplicities (if not empty, they replace the indices and cover all events) of source/target
+  void GetSample(INPUT input, const EventCache *& cache, const std::vector<long> *& indices, const std::vector<unsigned char> *& multiplicities) const;
+
+  // training context (histogram definitions and random number stream used by the nodes)
+  Context * m_context;
+
+  // bagging
+  bool m_bagging;
 
-  // histogram definitions
-  const HistDefs * m_histDefs;
+  // maximum number of layers and learning rate
+  int m_maxLayers;
+  float m_learningRate;
+
+  // number of threads used for filling nodes
+  int m_nThreads;
+  
+  // node settings (shared by all nodes of the tree)
+  Node::Settings m_nodeSettings;
+
+  // storage of nodes and branches (owned by the tree, addresses stay valid while growing)
+  std::deque<Node> m_nodePool;
+  std::deque<Branch> m_branchPool;
   
   // nodes
   std::vector<const Node *> m_nodes;
 
+  // flat version of the tree (owned by the tree when grown or read from a text file)
+  std::vector<FlatNode> m_flatNodes;
+  std::vector<float> m_flatWeights;
+
+  // flat arrays used for evaluation (point either to the vectors above, or to memory owned by someone else)
+  const FlatNode * m_nodeArray;
+  unsigned int m_nNodeArray;
+  const float * m_weightArray;
+  unsigned int m_nWeightArray;
+
+  // compiled evaluation function (if any)
+  mutable Function m_function;
+
   // logger
   mutable Log m_log;
 
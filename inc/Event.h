@@ -6,6 +6,7 @@
 
 // local includes
 #include "Log.h"
+#include "FieldHandle.h"
 
 // forward declarations
 class TTree;
@@ -40,6 +41,10 @@ public:
   template <typename T>
   const T & get(const std::string & key) const;
 
+  // get typed handle to variable (for use in event loops)
+  template <typename T>
+  FieldHandle<T> handle(const std::string & key) const;
+
   
 private:
 
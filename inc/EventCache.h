@@ -0,0 +1,101 @@
+#ifndef __EVENTCACHE__
+#define __EVENTCACHE__
+
+// stl includes
+#include <string>
+
+// local includes
+#include "Log.h"
+#include "ScratchBuffer.h"
+
+// forward declarations
+class TTree;
+class HistDefs;
+
+
+class EventCache {
+
+public:
+
+  // constructor (reads the entries of the TTree once, only this process' shard if there are several worker processes; the
+  // cache is kept in scratch files if there is a 'MemoryBudget')
+  EventCache(TTree * tree);
+
+  // disable copy-constructor and assignment operator
+  EventCache(const EventCache & other) = delete;
+  void operator=(const EventCache & other) = delete;
+
+  // destructor
+  ~EventCache() {}
+
+  // get name of cached TTree
+  const std::string & Name() const;
+
+  // get number of cached events
+  long Entries() const;
+
+  // get TTree entry of the first cached event, and number of entries of the TTree (summed over all worker processes)
+  long FirstEntry() const { return m_firstEntry; }
+  long TotalEntries() const { return m_totalEntries; }
+
+  // get value of variable (ivar is the position in Variables::Get())
+  float Value(unsigned int ivar, long ievent) const { return m_values.Data<float>()[ivar*m_entries + ievent]; }
+
+  // get intrinsic event weight
+  float Weight(long ievent) const { return m_weights.Data<float>()[ievent]; }
+
+  // get bin index of variable (0 = underflow, Nbins+1 = overflow), available after Quantize()
+  unsigned int Bin(unsigned int ivar, long ievent) const
+  {
+    long i = ivar*m_entries + ievent;
+    return m_wideBins ? m_bins.Data<unsigned short>()[i] : m_bins.Data<unsigned char>()[i];
+  }
+
+  // convert all values to bin indices of the histogram definitions (done once, when the variable ranges are known)
+  void Quantize(const HistDefs * histDefs);
+
+  // get column of a variable (Entries() values)
+  const float * Column(unsigned int ivar) const;
+
+  // get column of intrinsic event weights (Entries() values)
+  const float * Weights() const;
+
+  // get number of events to process in one go, so that the cached data of the events plus extraBytesPerEvent bytes of
+  // other per-event data fit into the 'MemoryBudget' (all events if there is no budget)
+  long ChunkSize(unsigned long extraBytesPerEvent = 0) const;
+
+  // drop the cached data of events [first, last) from memory (read again from the scratch files when accessed)
+  void Release(long first, long last) const;
+
+
+private:
+
+  // read TTree into columns
+  void Fill(TTree * tree);
+
+  // name of TTree
+  std::string m_name;
+
+  // number of events (cached, first cached entry, and entries of the TTree)
+  long m_entries;
+  long m_firstEntry;
+  long m_totalEntries;
+
+  // number of variables
+  unsigned int m_nVariables;
+
+  // one column per variable (stored one after the other), and one for the intrinsic event weight
+  ScratchBuffer m_values;
+  ScratchBuffer m_weights;
+
+  // one column of bin indices per variable (8-bit if all variables have at most 254 bins plus under/overflow, otherwise 16-bit)
+  ScratchBuffer m_bins;
+  bool m_wideBins;
+
+  // logger
+  mutable Log m_log;
+
+};
+
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __EVENTREADER__
+#define __EVENTREADER__
+
+// local includes
+#include "Log.h"
+#include "Schema.h"
+
+// forward declarations
+class TTree;
+
+
+class EventReader {
+
+public:
+
+  // constructor (connects the variables of the TTree to the buffers of this reader, independent of the Event singleton)
+  EventReader(TTree * tree);
+
+  // destructor
+  ~EventReader() {}
+
+  // read entry of the TTree
+  void GetEntry(long ientry);
+
+  // get values of all variables of the current entry (same order as Variables::Get())
+  void GetValues(float * values) const;
+
+
+private:
+
+  // tree
+  TTree * m_tree;
+
+  // one buffer per variable
+  Schema::Values m_values;
+
+  // logger
+  mutable Log m_log;
+
+};
+
+
+#endif
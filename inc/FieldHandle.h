@@ -0,0 +1,39 @@
+#ifndef Utilities_FieldHandle_H
+#define Utilities_FieldHandle_H
+
+// Analysis includes
+#include "Field.h"
+
+
+// Typed handle to a data field of a Store. The type is checked once, when the
+// handle is obtained from the Store, so dereferencing is a single pointer access.
+// A handle stays valid as long as its field is neither removed nor the Store flushed.
+template <class T>
+class FieldHandle {
+
+public:
+
+  // constructor (invalid handle)
+  FieldHandle() : m_field(0) {}
+
+  // constructor
+  explicit FieldHandle(Field<T> * field) : m_field(field) {}
+
+  // check if handle points to a field
+  bool valid() const { return m_field != 0; }
+
+  // method to retrieve value of field
+  T & get() const { return m_field->get(); }
+
+  // dereference
+  T & operator*() const { return m_field->get(); }
+  T * operator->() const { return &m_field->get(); }
+
+
+private:
+
+  Field<T> * m_field;
+
+};
+
+#endif
@@ -7,9 +7,11 @@
 // std includes
 #include <vector>
 #include <string>
+#include <memory>
 
 // forward declarations
 class DecisionTree;
+class QuickScorer;
 
 
 class Forest {
@@ -28,15 +30,43 @@ public:
 
   // get decision trees
   const std::vector<const DecisionTree *> & GetTrees() const;
+
+  // get weights of each tree for a batch of events (features of event i start at features[i*nVariables], the weight of
+  // tree t for event i is stored in treeWeights[t*nEvents + i]), using QuickScorer if all trees have at most 64 final nodes
+  void GetTreeWeights(const float * features, unsigned int nVariables, int nEvents, float * treeWeights) const;
   
-  // read in forest(s) from file
+  // read in forest(s) from file (text file written by CalculateWeights, or binary file written by WriteBinary)
   static const std::vector<const Forest *> ReadForests(const std::string & weightsFileName);
+
+  // write forest(s) to binary file: header, variable table, number of trees per forest, and the flat node/weight arrays of
+  // each tree (the file is memory-mapped when read, so processes on the same host share one copy in the page cache)
+  static void WriteBinary(const std::vector<const Forest *> & forests, const std::string & fileName);
+
+  // write C++ source in which each tree is a nest of if statements with constant cuts and a table of final node weights
+  // (compiled into a shared library by CompileForest)
+  static void WriteSource(const std::vector<const Forest *> & forests, const std::string & fileName);
+
+  // evaluate the trees with the functions of a shared library generated by CompileForest from the same forests
+  static void LoadCompiled(const std::vector<const Forest *> & forests, const std::string & libraryName);
+
+  // checksum of the flat arrays of all trees (identifies the forests a compiled library was generated from)
+  static unsigned long long Checksum(const std::vector<const Forest *> & forests);
   
 
 private:
 
+  // read in forest(s) from memory-mapped binary file
+  static const std::vector<const Forest *> ReadBinary(const std::string & fileName);
+
   // trees
   std::vector<const DecisionTree *> m_trees;
+
+  // feature-major evaluation of all trees (set up when the forest is created from complete trees, and dropped when the
+  // trees are evaluated with compiled functions instead, see LoadCompiled())
+  mutable std::unique_ptr<const QuickScorer> m_quickScorer;
+
+  // memory-mapped binary file the trees point into (shared by all forests read from the same file)
+  std::shared_ptr<const void> m_mapping;
  
   // log
   static Log m_log;
@@ -13,7 +13,7 @@
 
 
 // forward declarations
-class TTree;
+class EventCache;
 
 
 class HistDefs {
@@ -46,6 +46,17 @@ public:
     int Nbins() const { return m_nbins; }
     const Variable * GetVariable() const { return m_variable; }
 
+    // get lower edge of bin (same as TAxis::GetBinLowEdge)
+    double BinLowEdge(int bin) const { return m_xmin + (bin - 1)*((static_cast<double>(m_xmax) - m_xmin)/m_nbins); }
+
+    // get bin index of value (same convention as TAxis::FindFixBin : 0 = underflow, Nbins+1 = overflow)
+    int FindBin(float value) const
+    {
+      if ( value < m_xmin ) return 0;
+      if ( ! (value < m_xmax) ) return m_nbins + 1;
+      return 1 + static_cast<int>( m_nbins*(static_cast<double>(value) - m_xmin)/(static_cast<double>(m_xmax) - m_xmin) );
+    }
+
     
   private:
 
@@ -68,7 +79,7 @@ public:
   void Initialize();
 
   // update variable ranges
-  void UpdateVariableRanges(TTree * tree);
+  void UpdateVariableRanges(const EventCache * cache);
   
   // get entries
   const std::vector<Entry> & GetEntries() const;
@@ -30,6 +30,9 @@ public:
   // add histogram
   void AddHist(std::string name, int nbins, float xmin, float xmax);
 
+  // add existing histogram (takes ownership, e.g. of histograms filled in a Context)
+  void AddHist(TH1F * hist);
+
   // get histogram
   TH1F * GetHist(const std::string & name);
 
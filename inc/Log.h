@@ -61,6 +61,10 @@ public:
   // convert std::string to Log::LEVEL
   static LEVEL StringToLEVEL(const std::string & str_level);
 
+  // set prefix and minimum print level of all logs of this process (used by worker processes, so their output can be
+  // told apart from the first process, and doesn't repeat its messages)
+  static void SetProcess(const std::string & prefix, const LEVEL & level);
+
 
 private:
   
@@ -69,6 +73,13 @@ private:
   LEVEL          m_printlevel;
   LEVEL          m_currentlevel;
 
+  // check if the current message is printed
+  bool Printing() const { return m_currentlevel >= m_printlevel && m_currentlevel >= m_processLevel; }
+
+  // prefix and minimum print level of all logs of this process
+  static std::string m_processPrefix;
+  static LEVEL       m_processLevel;
+
 };
 
 #include "Log.icc"
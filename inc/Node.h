@@ -3,6 +3,7 @@
 
 //stl includes
 #include <vector>
+#include <deque>
 #include <string>
 #include <iostream>
 
@@ -10,14 +11,13 @@
 #include "Log.h"
 #include "HistDefs.h"
 
-// Rootv includes
-#include "TH1F.h"
-
 // forward declarations
 class Branch;
 class Event;
 class DecisionTree;
-class TTree;
+class EventCache;
+class Context;
+class Philox;
 
 
 class Node {
@@ -25,42 +25,130 @@ class Node {
 public:
 
 
-  // -----------------------
-  // class to hold histogram
-  // -----------------------
+  // ---------------------------------------------------------------------------------
+  // class to hold histogram (sums of weights and squared weights in an external buffer)
+  // ---------------------------------------------------------------------------------
   class Hist {
 
   public:
 
-    // constructor
-    Hist(const HistDefs::Entry & histDef) : m_hist(0), m_variable(histDef.GetVariable())
+    // constructor (the histogram can be filled once a buffer is set)
+    Hist(const HistDefs::Entry & histDef) : m_histDef(&histDef), m_sumw(0), m_sumw2(0) {}
+
+    // set buffer (Ncells() sums of weights followed by Ncells() sums of squared weights, initialised to zero by the owner)
+    void SetBuffer(double * buffer)
+    {
+      m_sumw  = buffer;
+      m_sumw2 = buffer + Ncells();
+    }
+
+    // fill histogram (bin index from EventCache::Bin())
+    void Fill(unsigned int bin, float weight)
+    {
+      m_sumw [bin] += weight;
+      m_sumw2[bin] += weight*weight;
+    }
+
+    // add sums of weights and squared weights per bin (including underflow and overflow)
+    void Add(const double * sumw, const double * sumw2)
     {
-      m_hist = new TH1F(histDef.Name().c_str(), histDef.Name().c_str(), histDef.Nbins(), histDef.Xmin(), histDef.Xmax());
-      m_hist->SetDirectory(0);
+      for (int bin = 0; bin < Ncells(); ++bin) {
+	m_sumw [bin] += sumw [bin];
+	m_sumw2[bin] += sumw2[bin];
+      }
     }
 
-    // destructor
-    ~Hist()
+    // set histogram to the difference of two histograms (sums of weights and squared weights per bin)
+    void Subtract(const Hist * hist1, const Hist * hist2)
     {
-      delete m_hist;
-      m_hist = 0;
+      for (int bin = 0; bin < Ncells(); ++bin) {
+	m_sumw [bin] = hist1->m_sumw [bin] - hist2->m_sumw [bin];
+	m_sumw2[bin] = hist1->m_sumw2[bin] - hist2->m_sumw2[bin];
+      }
     }
 
-    // fill histogram
-    void Fill(float weight) { m_hist->Fill(m_variable->Value(), weight); }
+    // get number of bins (including underflow and overflow)
+    int Ncells() const { return m_histDef->Nbins() + 2; }
+
+    // get sums of weights and squared weights per bin (including underflow and overflow)
+    const double * Sumw () const { return m_sumw;  }
+    const double * Sumw2() const { return m_sumw2; }
+
+    // get integral (including underflow and overflow)
+    double Integral() const
+    {
+      double sum = 0;
+      for (int bin = 0; bin < Ncells(); ++bin) sum += m_sumw[bin];
+      return sum;
+    }
+
+    // get lower edge of bin
+    double BinLowEdge(int bin) const { return m_histDef->BinLowEdge(bin); }
+
+    // get variable
+    const Variable * GetVariable() const { return m_histDef->GetVariable(); }
 
     // get name
-    const std::string & Name() const { return m_variable->Name(); }
+    const std::string & Name() const { return m_histDef->Name(); }
+
     
-    // get ROOT hist
-    const TH1F * ROOTHist() const { return m_hist; }
+  private:
+
+    // histogram definition and buffer
+    const HistDefs::Entry * m_histDef;
+    double * m_sumw;
+    double * m_sumw2;
+
+  };
+
+  // ----------------------------------------------------
+  // class to hold integrals below/above each histogram bin
+  // ----------------------------------------------------
+  class Integrals {
+
+  public:
 
+    // constructor (cumulative sums of weights and squared weights, built in one sweep from each side)
+    Integrals(const Hist * hist) : m_low(hist->Ncells()), m_lowErr2(hist->Ncells()), m_high(hist->Ncells()), m_highErr2(hist->Ncells())
+    {
+      const double * sumw  = hist->Sumw();
+      const double * sumw2 = hist->Sumw2();
+      int ncells = hist->Ncells();
+      double sumLow = 0;
+      double sumLowErr2 = 0;
+      for (int bin = 0; bin < ncells; ++bin) {
+	sumLow     += sumw[bin];
+	sumLowErr2 += sumw2[bin];
+	m_low    [bin] = sumLow;
+	m_lowErr2[bin] = sumLowErr2;
+      }
+      double sumHigh = 0;
+      double sumHighErr2 = 0;
+      for (int bin = ncells - 1; bin >= 0; --bin) {
+	m_high    [bin] = sumHigh;
+	m_highErr2[bin] = sumHighErr2;
+	sumHigh     += sumw[bin];
+	sumHighErr2 += sumw2[bin];
+      }
+    }
+
+    // get integral (and squared error) of bins [0, bin] and [bin+1, Nbins+1]
+    double Low     (int bin) const { return m_low     [bin]; }
+    double LowErr2 (int bin) const { return m_lowErr2 [bin]; }
+    double High    (int bin) const { return m_high    [bin]; }
+    double HighErr2(int bin) const { return m_highErr2[bin]; }
+
+    // get number of bins (including underflow and overflow)
+    int Ncells() const { return m_low.size(); }
     
+
   private:
 
-    // histogram and variable
-    TH1F * m_hist;
-    const Variable * m_variable;
+    // cumulative sums
+    std::vector<double> m_low;
+    std::vector<double> m_lowErr2;
+    std::vector<double> m_high;
+    std::vector<double> m_highErr2;
 
   };
 
@@ -71,41 +159,50 @@ public:
 
   public:
 
-    // constructor
-    Summary(Hist * source, Hist * target, float cutValue, float chisquare, float sumInitLow, float sumTargLow, float sumInitHigh, float sumTargHigh) :
-      m_source(source), m_target(target), m_cutValue(cutValue), m_chisquare(chisquare), m_sumSourceLow(sumInitLow), m_sumTargetLow(sumTargLow), m_sumSourceHigh(sumInitHigh), m_sumTargetHigh(sumTargHigh) {}
+    // number of values of a summary in flat form (see Pack())
+    static const unsigned int NVALUES = 11;
 
-    ~Summary()
-    {
-      // delete m_source;
-      // delete m_target;
-      // m_source = 0;
-      // m_target = 0;
-    }
+    // constructor (position is the position of the variable among the variables used for splitting the node)
+    Summary(const Hist * source, const Hist * target, unsigned int position, float cutValue, int cutBin, float chisquare, float sumInitLow, float sumTargLow, float sumInitHigh, float sumTargHigh) :
+      m_variable(source->GetVariable()), m_position(position), m_cutValue(cutValue), m_cutBin(cutBin), m_chisquare(chisquare), m_sumSourceLow(sumInitLow), m_sumTargetLow(sumTargLow), m_sumSourceHigh(sumInitHigh), m_sumTargetHigh(sumTargHigh), m_sumSource(source->Integral()), m_sumTarget(target->Integral()) {}
+
+    // constructor (from flat form, e.g. received from another process)
+    Summary(const double * values);
+
+    ~Summary() {}
+
+    // write summary in flat form (NVALUES values)
+    void Pack(double * values) const;
     
     // get information
-    const Hist * SourceHist() const { return m_source; }
-    const Hist * TargetHist() const { return m_target; }
+    unsigned int Position() const { return m_position; }
     float CutValue     () const { return m_cutValue;      }
+    int   CutBin       () const { return m_cutBin;        }
     float Chisquare    () const { return m_chisquare;     }
     float SumSourceLow () const { return m_sumSourceLow;  }
     float SumTargetLow () const { return m_sumTargetLow;  }
     float SumSourceHigh() const { return m_sumSourceHigh; }
     float SumTargetHigh() const { return m_sumTargetHigh; }
-    const std::string & Name() const { return m_source->Name(); }
+    float SumSource    () const { return m_sumSource;     }
+    float SumTarget    () const { return m_sumTarget;     }
+    const std::string & Name() const;
+    const Variable * GetVariable() const { return m_variable; }
 
     
   private:
 
     // summary info
-    Hist * m_source;
-    Hist * m_target;
+    const Variable * m_variable;
+    unsigned int m_position;
     float m_cutValue;
+    int   m_cutBin;
     float m_chisquare;
     float m_sumSourceLow;
     float m_sumTargetLow;
     float m_sumSourceHigh;
     float m_sumTargetHigh;
+    float m_sumSource;
+    float m_sumTarget;
     
   };
   
@@ -124,10 +221,44 @@ public:
     CHISQUARE,
     RANDOM
   };
+
+
+  // ---------------------------------------------------------------------
+  // class to hold settings (read once per decision tree, shared by its nodes)
+  // ---------------------------------------------------------------------
+  class Settings {
+
+  public:
+
+    // constructor (reads the configuration)
+    Settings();
+
+    // get settings
+    int       MinEvents           () const { return m_minEvents;            }
+    bool      DoFeatSampling      () const { return m_doFeatSampling;       }
+    float     FeatSamplingFraction() const { return m_featSamplingFraction; }
+    SPLITMODE SplitMode           () const { return m_splitMode;            }
+
+    // get logger
+    Log & GetLog() const { return m_log; }
+
+    
+  private:
+
+    // settings
+    int       m_minEvents;
+    bool      m_doFeatSampling;
+    float     m_featSamplingFraction;
+    SPLITMODE m_splitMode;
+
+    // logger
+    mutable Log m_log;
+
+  };
   
   
   // constructors
-  Node(Branch * input = 0);
+  Node(Branch * input, const Settings & settings);
 
   // destructor
   ~Node();
@@ -144,8 +275,12 @@ public:
   // get input branch
   const Branch * InputBranch() const;
 
+  // get id of the node in the tree (1 for the first node, 2*id and 2*id+1 for the nodes below/above its cut)
+  unsigned long long Id() const { return m_id; }
+
   // get output branch
-  const Branch * OutputBranch() const;
+  const Branch * OutputBranch(const float * features) const;
+  const Branch * OutputBranch(const EventCache * cache, long ievent) const;
 
   // check if output branch exist
   const Branch * OutputBranch(bool isGreater) const;
@@ -153,19 +288,44 @@ public:
   // set output branch (for reconstructing decision tree)
   void SetOutputBranch(const Branch * branch, bool isGreater);
   
-  // intialize histograms
-  void Initialize(const HistDefs * histDefs);
+  // intialize histograms (from the context's histogram definitions, the node's random number stream is used for feature sampling)
+  void Initialize(Context & context);
   
   // fill histograms
-  void FillSource(float weight);
-  void FillTarget(float weight);
+  void FillSource(const EventCache * cache, long ievent, float weight);
+  void FillTarget(const EventCache * cache, long ievent, float weight);
+
+  // fill external buffer with same layout as the histograms (used for multi-threaded filling), and add it to the histograms
+  unsigned int BufferSize() const;
+  void FillBuffer(const EventCache * cache, long ievent, float weight, double * sumw, double * sumw2) const;
+  void AddSource(const double * sumw, const double * sumw2);
+  void AddTarget(const double * sumw, const double * sumw2);
 
-  // build node
-  void Build(Branch *& b1, Branch *& b2);
+  // get size of the histogram buffer (source and target histograms), and set the buffer (initialised to zero by the owner)
+  unsigned int HistBufferSize() const;
+  void SetHistBuffer(double * buffer);
 
-  // node splitting functions
+  // check if this node has histograms for all variables of another node
+  bool HasHists(const Node * node) const;
+
+  // get histograms by subtracting the sibling's histograms from the parent's (instead of filling them)
+  void Subtract(const Node * parent, const Node * sibling);
+
+  // remove histograms (the buffer can then be reused)
+  void ClearHists();
+
+  // get split of the node from its histograms (null if there is none; the node's random number stream is used for random splits)
+  Summary * Split(Context & context);
+
+  // build node from its split (the output branches are added to 'branches', the summary is deleted, and the histograms are kept until removed with ClearHists())
+  void Build(Branch *& b1, Branch *& b2, std::deque<Branch> & branches, Summary * nodeSummary);
+
+  // node splitting functions (in feature-parallel mode, only the variables of this process are considered)
   Summary * SplitChisquare();
-  Summary * SplitRandom();
+  Summary * SplitRandom(Philox & random);
+
+  // get chisquare of the cut above each bin (negative if the cut leaves too few events on either side)
+  void ScanCuts(const Integrals & source, const Integrals & target, std::vector<float> & chisquares) const;
   
   // get #source
   float SumSource() const;
@@ -187,6 +347,9 @@ private:
 
   // status
   STATUS m_status;
+
+  // id in the tree
+  unsigned long long m_id;
   
   // I/O branches
   const Branch * m_input;
@@ -197,22 +360,25 @@ private:
   mutable float m_weight;
   mutable bool  m_weightIsSet;
 
-  // histograms
-  std::vector<Hist *> m_histSetSource;
-  std::vector<Hist *> m_histSetTarget;
+  // histograms (in feature-parallel mode only for the variables of this process), and the position of their variables
+  // among all m_nVariables variables used for splitting the node
+  std::vector<Hist> m_histSetSource;
+  std::vector<Hist> m_histSetTarget;
+  std::vector<unsigned int> m_positions;
+  unsigned int m_nVariables;
   
   // sum of events
   float m_sumSource;
   float m_sumTarget;
 
-  // switch for doing feature sampling
-  bool m_doFeatSampling;
+  // get histogram of a variable (null if there is none)
+  const Hist * FindHist(const std::vector<Hist> & histSet, const Variable * variable) const;
 
-  // switch for split mode
-  SPLITMODE m_splitMode;
+  // settings
+  const Settings & m_settings;
   
-  // logger
-  mutable Log m_log;
+  // logger (owned by the settings)
+  Log & m_log;
 
 };
 
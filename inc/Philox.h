@@ -0,0 +1,92 @@
+#ifndef __PHILOX__
+#define __PHILOX__
+
+// stl includes
+#include <cstdint>
+
+
+// Counter-based random number stream (Philox4x32-10). A stream is fully determined by its key (seed, tree index, node id,
+// purpose), so each tree and node draws the same numbers no matter in which order, or on which thread, they are grown.
+class Philox {
+
+public:
+
+  // purpose of a stream (streams with different purposes are independent)
+  enum PURPOSE {
+    BAGGING_SOURCE = 1,
+    BAGGING_TARGET,
+    FEATURE_SAMPLING,
+    RANDOM_SPLIT
+  };
+
+  // constructor (node is the id of the node in the tree, see Node::Id(), or 0 for streams of the whole tree)
+  Philox(unsigned int seed, unsigned int tree, unsigned long long node, PURPOSE purpose) :
+    m_key{seed, tree},
+    m_counter{0, static_cast<uint32_t>(purpose), static_cast<uint32_t>(node), static_cast<uint32_t>(node >> 32)},
+    m_block{0, 0, 0, 0},
+    m_position(4)
+  {}
+
+  // get next 32 random bits
+  uint32_t Next()
+  {
+    if ( m_position == 4 ) {
+      Generate();
+      m_position = 0;
+    }
+    return m_block[m_position++];
+  }
+
+  // get uniform random number in (0, 1) (same range and resolution as TRandom3::Rndm())
+  double Rndm() { return (Next() + 0.5) * (1./4294967296.); }
+
+  // skip the next n numbers (Next() calls), without generating them
+  void Skip(unsigned long long n)
+  {
+    unsigned long long position = 4ULL*m_counter[0] - (4 - m_position) + n;
+    m_counter[0] = static_cast<uint32_t>(position/4);
+    m_position = 4;
+    if ( position % 4 != 0 ) {
+      Generate();
+      m_position = position % 4;
+    }
+  }
+
+
+private:
+
+  // generate the block of the current counter, and increment the counter
+  void Generate()
+  {
+    uint32_t c[4] = {m_counter[0], m_counter[1], m_counter[2], m_counter[3]};
+    uint32_t k[2] = {m_key[0], m_key[1]};
+    for (int round = 0; round < 10; ++round) {
+      if ( round > 0 ) {
+	k[0] += 0x9E3779B9;
+	k[1] += 0xBB67AE85;
+      }
+      uint64_t p0 = static_cast<uint64_t>(0xD2511F53) * c[0];
+      uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57) * c[2];
+      uint32_t c1 = c[1];
+      uint32_t c3 = c[3];
+      c[0] = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k[0];
+      c[1] = static_cast<uint32_t>(p1);
+      c[2] = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k[1];
+      c[3] = static_cast<uint32_t>(p0);
+    }
+    for (int i = 0; i < 4; ++i) m_block[i] = c[i];
+    ++m_counter[0];
+  }
+
+  // key and counter (block index, purpose, node id)
+  uint32_t m_key[2];
+  uint32_t m_counter[4];
+
+  // current block of random numbers
+  uint32_t m_block[4];
+  int m_position;
+
+};
+
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __QUICKSCORER__
+#define __QUICKSCORER__
+
+// stl includes
+#include <vector>
+#include <cstdint>
+
+// local includes
+#include "Log.h"
+
+// forward declarations
+class DecisionTree;
+
+
+// feature-major evaluation of trees with at most 64 final nodes (QuickScorer): the final nodes of each tree are bits of a
+// 64-bit mask, and for each variable the cuts of all trees are scanned once in increasing order, clearing the final nodes
+// below every cut the event passes; the leftmost remaining final node is the one the event ends up in
+class QuickScorer {
+
+public:
+
+  // maximum number of final nodes per tree
+  static const unsigned int MAXLEAVES = 64;
+
+  // check if all trees can be evaluated
+  static bool Supports(const std::vector<const DecisionTree *> & trees);
+
+  // constructor
+  QuickScorer(const std::vector<const DecisionTree *> & trees);
+
+  // destructor
+  ~QuickScorer() {}
+
+  // get weights of each tree for a batch of events (features of event i start at features[i*nVariables], the weight of
+  // tree t for event i is stored in treeWeights[t*nEvents + i])
+  void GetTreeWeights(const float * features, unsigned int nVariables, int nEvents, float * treeWeights) const;
+
+
+private:
+
+  // add the cuts of a subtree, returns the number of final nodes in it
+  unsigned int AddNode(const DecisionTree * tree, unsigned int itree, int inode, unsigned int firstLeaf);
+
+  // number of trees
+  unsigned int m_nTrees;
+
+  // cuts of all trees, sorted by variable and cut value (m_first[ivar] is the position of the first cut on variable ivar)
+  struct Cut {
+    unsigned int variable;
+    float cutValue;
+    unsigned int tree;
+    uint64_t mask;
+  };
+  std::vector<Cut> m_cuts;
+  std::vector<unsigned int> m_first;
+
+  // weights of the final nodes from left to right (MAXLEAVES per tree)
+  std::vector<float> m_leafWeights;
+
+  // logger
+  mutable Log m_log;
+
+};
+
+
+#endif
@@ -11,7 +11,11 @@
 
 // forward declarations
 class Forest;
+class DecisionTree;
 class HistDefs;
+class Context;
+class EventCache;
+class TH1F;
 class TTree;
 
 
@@ -35,12 +39,18 @@ public:
   // write weights to outout file
   virtual void Write(std::ofstream & outfile);
 
-  // get weight
-  virtual void GetWeight(float & weight, float & error) const;
+  // get weights of a batch of events
+  virtual void GetWeights(const float * features, long nEvents, float * weights, float * errors) const;
 
   
 private:
 
+  // grow a single tree (with its own bagging indices and random number stream)
+  virtual DecisionTree * GrowTree(Context & context, int nThreads);
+
+  // fill histograms of all variables with the events of a sub-sample
+  void FillHists(const std::vector<TH1F *> & hists, const EventCache * cache, const std::vector<long> & indices, const std::vector<unsigned char> & multiplicities) const;
+
   // histogram definitions
   HistDefs * m_histDefs;
 
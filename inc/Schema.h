@@ -0,0 +1,46 @@
+#ifndef __SCHEMA__
+#define __SCHEMA__
+
+
+// compile-time description of the reweighting variables in 'inc/VARIABLES' (same order as Variables::Get())
+namespace Schema {
+
+  // index of each variable, and number of variables
+  enum INDEX {
+    #define VARIABLE(name, type) name,
+    #include "VARIABLES"
+    #undef VARIABLE
+    NVARIABLES
+  };
+
+  // typed values of one event (as stored in the TTree)
+  struct Values {
+    #define VARIABLE(name, type) type name;
+    #include "VARIABLES"
+    #undef VARIABLE
+  };
+
+  // table of variables (name, type, index)
+  struct Entry {
+    const char * name;
+    const char * type;
+    unsigned int index;
+  };
+  constexpr Entry TABLE[NVARIABLES] = {
+    #define VARIABLE(name, type) { #name, #type, name },
+    #include "VARIABLES"
+    #undef VARIABLE
+  };
+
+  // convert typed values to features (position = index of the variable)
+  inline void ToFeatures(const Values & values, float * features)
+  {
+    #define VARIABLE(name, type) features[name] = static_cast<float>(values.name);
+    #include "VARIABLES"
+    #undef VARIABLE
+  }
+
+}
+
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __SCRATCHBUFFER__
+#define __SCRATCHBUFFER__
+
+// stl includes
+#include <string>
+
+// local includes
+#include "Log.h"
+
+
+// Zero-initialised buffer for per-event data. It is either kept in memory, or mapped from a scratch file (out-of-core
+// training with a 'MemoryBudget'), in which case parts which are no longer needed can be released from memory.
+class ScratchBuffer {
+
+public:
+
+  // constructor (empty buffer)
+  ScratchBuffer();
+
+  // disable copy-constructor and assignment operator
+  ScratchBuffer(const ScratchBuffer & other) = delete;
+  void operator=(const ScratchBuffer & other) = delete;
+
+  // destructor
+  ~ScratchBuffer();
+
+  // allocate buffer of the given size in bytes (in memory if directory is empty, otherwise in a scratch file of that
+  // directory which is removed when the buffer is freed); previous contents are discarded
+  void Allocate(unsigned long size, const std::string & directory = "");
+
+  // free buffer
+  void Free();
+
+  // get data
+  template <class T>
+  T * Data() const { return static_cast<T *>(m_data); }
+
+  // get size in bytes
+  unsigned long Size() const { return m_size; }
+
+  // check if buffer is mapped from a scratch file
+  bool IsMapped() const { return m_fd >= 0; }
+
+  // write the pages holding bytes [offset, offset + size) back to the scratch file and drop them from memory (they are
+  // read again when accessed, nothing is done for buffers in memory)
+  void Release(unsigned long offset, unsigned long size) const;
+
+  // get scratch directory from the configuration ('ScratchDirectory', default /tmp), or an empty string if there is
+  // no 'MemoryBudget' (in MB)
+  static std::string Directory();
+
+  // get number of events per chunk so that bytesPerEvent bytes of per-event data fit into the 'MemoryBudget'
+  // (all events if there is no budget)
+  static long ChunkSize(long nEvents, unsigned long bytesPerEvent);
+
+
+private:
+
+  // data
+  void * m_data;
+  unsigned long m_size;
+
+  // scratch file (-1 if in memory)
+  int m_fd;
+
+  // logger
+  mutable Log m_log;
+
+};
+
+
+#endif
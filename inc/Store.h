@@ -9,7 +9,7 @@
 
 // Framework includes
 #include "Log.h"
-#include "Store.h"
+#include "FieldHandle.h"
 
 // Forward declarations
 class FieldBase;
@@ -43,10 +43,18 @@ class Store {
   template <class T> 
   bool getif(const std::string & key, T & value) const;
 
+  // get typed handle to data field (type is checked once here, dereferencing is O(1))
+  template <class T>
+  FieldHandle<T> handle(const std::string & key);
+
+  // get typed handle to data field (if it is there, otherwise the handle is invalid)
+  template <class T>
+  FieldHandle<T> handleif(const std::string & key);
+
   // check if exists
   bool exists(const std::string & name) const;
   
-  // put data field in store
+  // put data field in store (overwriting keeps the field, so handles to it stay valid)
   template <class T> 
   void put(const std::string & key, const T & value, bool overwrite = false);
 
@@ -65,6 +73,10 @@ class Store {
 
   // map of data fields
   std::map<std::string, FieldBase *> m_data;
+
+  // find typed data field (0 if it doesn't exist, throws if it has a different type)
+  template <class T>
+  Field<T> * find(const std::string & key, const char * caller) const;
   
   // convert string field to other type, used by createStore()
   template <class T>
@@ -6,6 +6,7 @@
 
 // local includes
 #include "Log.h"
+#include "Variables.h"
 
 
 class Variable {
@@ -13,26 +14,32 @@ class Variable {
 public:
 
   // constructor
-  Variable(const std::string & name) : m_name(name), m_log(name)
+  Variable(const std::string & name, unsigned int index) : m_name(name), m_index(index), m_log(name)
   {
     m_log << Log::INFO << "Added variable : " << m_name << Log::endl();
   }
 
   // destructor
-  virtual ~Variable() {}
+  ~Variable() {}
 
-  // get value
-  virtual float Value() const = 0;
+  // get value of the current event (from the event buffer filled by Variables::Read())
+  float Value() const { return Variables::Values()[m_index]; }
   
   // get name
   const std::string & Name() const { return m_name; }
 
+  // get index (position in Variables::Get(), and column in EventCache)
+  unsigned int Index() const { return m_index; }
+
   
 protected:
 
   // name of variable
   const std::string m_name;
 
+  // index of variable
+  const unsigned int m_index;
+
   // logger
   Log m_log;
   
@@ -16,6 +16,18 @@ public:
   static std::vector<const Variable *> & Get();
   static const Variable * Get(const std::string & name);  
 
+  // get values of all variables for the current event (same order as Get())
+  static void GetValues(float * values);
+
+  // read values of all variables for the current event into the event buffer
+  static void Read();
+
+  // get event buffer (the value of each variable is at the position Variable::Index(), filled by Read())
+  static const float * Values();
+
+  // connect variables to the Event buffers (done by Event::ConnectAllVariables())
+  static void Connect();
+
   // initialize
   static void Initialize();
   
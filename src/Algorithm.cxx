@@ -1,23 +1,45 @@
 // analysis inlcudes
 #include "Algorithm.h"
 #include "Config.h"
-#include "Event.h"
+#include "EventCache.h"
+#include "DecisionTree.h"
+#include "Forest.h"
+#include "Variables.h"
+#include "Context.h"
+#include "HistService.h"
+#include "Communicator.h"
 
 // ROOT includes
 #include "TTree.h"
-#include "TRandom3.h"
+#include "TH1.h"
+#include "TH1F.h"
+#include "TROOT.h"
 
 // stl includes
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 
 
 Algorithm::Algorithm() :
   m_source(0),
   m_target(0),
-  m_indicesSource(0),
-  m_indicesTarget(0),
+  m_cacheSource(0),
+  m_cacheTarget(0),
+  m_aliasSource(),
+  m_aliasTarget(),
+  m_sumWeightsSource(0),
+  m_sumWeightsTarget(0),
+  m_shardFractionsSource(),
+  m_shardFractionsTarget(),
+  m_normalization(-1),
   m_weights(),
+  m_features(),
   m_log("Algorithm")
 {
  
@@ -35,9 +57,17 @@ Algorithm::Algorithm() :
 Algorithm::Algorithm(TTree * source, TTree * target) :
   m_source(source),
   m_target(target),
-  m_indicesSource(0),
-  m_indicesTarget(0),
+  m_cacheSource(0),
+  m_cacheTarget(0),
+  m_aliasSource(),
+  m_aliasTarget(),
+  m_sumWeightsSource(0),
+  m_sumWeightsTarget(0),
+  m_shardFractionsSource(),
+  m_shardFractionsTarget(),
+  m_normalization(-1),
   m_weights(),
+  m_features(),
   m_log("Algorithm")
 {
 
@@ -52,122 +82,371 @@ Algorithm::Algorithm(TTree * source, TTree * target) :
 }
 
 
-void Algorithm::PrepareIndices()
+Algorithm::~Algorithm()
 {
 
-  m_log << Log::INFO << "PrepareIndices() : Preparing sorted vector of event indices" << Log::endl();
+  delete m_cacheSource;
+  delete m_cacheTarget;
 
-  // delete previous indices (if any)
-  delete m_indicesSource;
-  delete m_indicesTarget;
-  m_indicesSource = 0;
-  m_indicesTarget = 0;
-  
-  // get info needed to create lists indices
-  long maxEventSource = m_source->GetEntries();
-  long maxEventTarget = m_target->GetEntries();
-  static float samplingFraction   = Config::Instance().get<float>("SamplingFraction");
-  static int samplingFractionSeed = Config::Instance().get<float>("SamplingFractionSeed");
-  static TRandom3 ran( samplingFractionSeed );
-  static bool bagging = false;
+}
+
+
+void Algorithm::FillCache()
+{
+
+  // read source and target trees into memory (only done once)
+  if ( ! m_cacheSource ) m_cacheSource = new EventCache(m_source);
+  if ( ! m_cacheTarget ) m_cacheTarget = new EventCache(m_target);
+
+  // sums of the event weights and alias tables, used for drawing random sub-samples (only done once)
+  bool bagging = false;
   Config::Instance().getif<bool>("Bagging", bagging); 
+  bool poissonBagging = false;
+  Config::Instance().getif<bool>("PoissonBagging", poissonBagging); 
+  if ( bagging && ! (m_sumWeightsSource > 0) ) {
+    SumWeights(m_cacheSource, m_sumWeightsSource, m_shardFractionsSource);
+    SumWeights(m_cacheTarget, m_sumWeightsTarget, m_shardFractionsTarget);
+    if ( ! (m_sumWeightsSource > 0 && m_sumWeightsTarget > 0) ) {
+      m_log << Log::ERROR << "FillCache() : Sum of event weights is not positive!" << Log::endl();
+      throw(0);
+    }
+  }
+  if ( bagging && ! poissonBagging && m_aliasSource.Empty() ) {
+    if ( ! ScratchBuffer::Directory().empty() ) {
+      m_log << Log::WARNING << "FillCache() : Alias tables and event indices used for bagging are kept in memory, which is not covered by 'MemoryBudget' (use 'PoissonBagging')" << Log::endl();
+    }
+    m_aliasSource.Build(m_cacheSource->Weights(), m_cacheSource->Entries());
+    m_aliasTarget.Build(m_cacheTarget->Weights(), m_cacheTarget->Entries());
+  }
+
+}
+
+
+void Algorithm::SumWeights(const EventCache * cache, double & sum, double * shardFractions) const
+{
+
+  // sum positive event weights of this process' shard (chunk by chunk)
+  double shardSum = 0;
+  const float * weights = cache->Weights();
+  long maxEvent = cache->Entries();
+  long chunkSize = cache->ChunkSize();
+  for (long first = 0; first < maxEvent; first += chunkSize) {
+    long last = std::min(first + chunkSize, maxEvent);
+    for (long ievent = first; ievent < last; ++ievent) if ( weights[ievent] > 0 ) shardSum += weights[ievent];
+    cache->Release(first, last);
+  }
+
+  // get sums of all shards, and add them up in order of rank (so all processes get the same boundaries)
+  Communicator & communicator = Communicator::Instance();
+  std::vector<double> shardSums(communicator.NumberOfShards(), 0.);
+  shardSums[communicator.ShardIndex()] = shardSum;
+  communicator.AllReduceShards(shardSums.data(), shardSums.size());
+  double sumBefore = 0;
+  double sumUpTo = 0;
+  sum = 0;
+  for (int shard = 0; shard < communicator.NumberOfShards(); ++shard) {
+    sum += shardSums[shard];
+    if ( shard <  communicator.ShardIndex() ) sumBefore = sum;
+    if ( shard == communicator.ShardIndex() ) sumUpTo   = sum;
+  }
+  shardFractions[0] = sum > 0 ? sumBefore/sum : 0.;
+  shardFractions[1] = sum > 0 ? sumUpTo  /sum : 0.;
+
+}
+
+
+void Algorithm::PrepareIndices(Context & context) const
+{
+
+  // get info needed to create lists indices (the sub-samples are drawn from the events of all processes)
+  long maxEventSource = m_cacheSource->Entries();
+  long maxEventTarget = m_cacheTarget->Entries();
+  long nDrawsSource = 0;
+  long nDrawsTarget = 0;
+  float samplingFraction = Config::Instance().get<float>("SamplingFraction");
+  bool bagging = false;
+  Config::Instance().getif<bool>("Bagging", bagging); 
+  bool poissonBagging = false;
+  Config::Instance().getif<bool>("PoissonBagging", poissonBagging); 
+  std::vector<long> & indicesSource = context.IndicesSource();
+  std::vector<long> & indicesTarget = context.IndicesTarget();
+  Philox ranSource = context.Stream(0, Philox::BAGGING_SOURCE);
+  Philox ranTarget = context.Stream(0, Philox::BAGGING_TARGET);
   
-  if ( bagging ) {
+  // indices are in ascending order to optimise reading of the event cache (sequential access), and so duplicate indices are adjacent (see DecisionTree::UpdateWeights)
+  indicesSource.clear();
+  indicesTarget.clear();
+  context.MultiplicitySource().clear();
+  context.MultiplicityTarget().clear();
+  if ( bagging && poissonBagging ) {
+
+    // random subset (each event is used as often as drawn from its Poisson distribution, events are read sequentially)
+    if ( ! (m_sumWeightsSource > 0 && m_sumWeightsTarget > 0) ) {
+      std::lock_guard<std::mutex> lock(m_logMutex);
+      m_log << Log::ERROR << "PrepareIndices() : Sums of the event weights are not available (call FillCache() first)" << Log::endl();
+      throw(0);
+    }
 
-    // random subset (sampling with replacement)
+    // one random number per event (skip those of the events of the processes before, so the multiplicities don't depend on the number of processes)
+    nDrawsSource = std::ceil(m_cacheSource->TotalEntries()*samplingFraction);
+    nDrawsTarget = std::ceil(m_cacheTarget->TotalEntries()*samplingFraction);
+    ranSource.Skip(m_cacheSource->FirstEntry());
+    ranTarget.Skip(m_cacheTarget->FirstEntry());
 
     // ---> source
-    m_log << Log::INFO << "PrepareIndices() : ---> source" << Log::endl();
-    m_indicesSource = new std::vector<long>();
-    m_indicesSource->reserve(maxEventSource*samplingFraction);
-    static std::vector<float> cumulativeSource(maxEventSource);
-    for (long ievent = 0; ievent < maxEventSource; ++ievent) {
-      m_source->GetEntry( ievent );
-      static const std::string & eventWeightName = Config::Instance().get<std::string>("EventWeightVariableName");
-      static const float & eventWeight = Event::Instance().get<float>(eventWeightName);
-      cumulativeSource.at(ievent) = eventWeight;
-      if (ievent > 0) cumulativeSource.at(ievent) += cumulativeSource.at(ievent-1);
-    }
-    while (m_indicesSource->size() < maxEventSource*samplingFraction) m_indicesSource->push_back( BinarySearchIndex(cumulativeSource, ran.Rndm()*cumulativeSource.back(), 0, cumulativeSource.size() - 1) );
+    DrawMultiplicities(m_cacheSource, m_sumWeightsSource, nDrawsSource, ranSource, context.MultiplicitySource());
 
     // ---> target
-    m_log << Log::INFO << "PrepareIndices() : ---> target" << Log::endl();
-    m_indicesTarget = new std::vector<long>();
-    m_indicesTarget->reserve(maxEventTarget*samplingFraction);
-    static std::vector<float> cumulativeTarget(maxEventTarget);
-    for (long ievent = 0; ievent < maxEventTarget; ++ievent) {
-      m_target->GetEntry( ievent );
-      static const std::string & eventWeightName = Config::Instance().get<std::string>("EventWeightVariableName");
-      static const float & eventWeight = Event::Instance().get<float>(eventWeightName);
-      cumulativeTarget.at(ievent) = eventWeight;
-      if (ievent > 0) cumulativeTarget.at(ievent) += cumulativeTarget.at(ievent-1);
+    DrawMultiplicities(m_cacheTarget, m_sumWeightsTarget, nDrawsTarget, ranTarget, context.MultiplicityTarget());
+
+  }
+  else if ( bagging ) {
+
+    // random subset (sampling with replacement, drawn in ascending order)
+    if ( m_aliasSource.Empty() || m_aliasTarget.Empty() ) {
+      std::lock_guard<std::mutex> lock(m_logMutex);
+      m_log << Log::ERROR << "PrepareIndices() : Alias tables of the event weights are not available (call FillCache() first)" << Log::endl();
+      throw(0);
     }
-    while (m_indicesTarget->size() < maxEventTarget*samplingFraction) m_indicesTarget->push_back( BinarySearchIndex(cumulativeTarget, ran.Rndm()*cumulativeTarget.back(), 0, cumulativeTarget.size() - 1) );
+
+    // the draws are split between the processes in proportion to the sums of weights of their shards (each process uses
+    // its own part of the random number stream, two numbers per draw)
+    nDrawsSource = std::ceil(m_cacheSource->TotalEntries()*samplingFraction);
+    nDrawsTarget = std::ceil(m_cacheTarget->TotalEntries()*samplingFraction);
+    long firstDrawSource = std::llround(nDrawsSource*m_shardFractionsSource[0]);
+    long firstDrawTarget = std::llround(nDrawsTarget*m_shardFractionsTarget[0]);
+    ranSource.Skip(2*firstDrawSource);
+    ranTarget.Skip(2*firstDrawTarget);
+
+    // ---> source
+    m_aliasSource.DrawSorted(std::llround(nDrawsSource*m_shardFractionsSource[1]) - firstDrawSource, ranSource, indicesSource);
+
+    // ---> target
+    m_aliasTarget.DrawSorted(std::llround(nDrawsTarget*m_shardFractionsTarget[1]) - firstDrawTarget, ranTarget, indicesTarget);
     
   }
   else {
 
     // use all events
     // ---> source
-    m_log << Log::INFO << "PrepareIndices() : ---> source" << Log::endl();
-    m_indicesSource = new std::vector<long>();
-    m_indicesSource->reserve(maxEventSource);
-    for (long ievent = 0; ievent < maxEventSource; ++ievent) m_indicesSource->push_back(ievent);
+    indicesSource.reserve(maxEventSource);
+    for (long ievent = 0; ievent < maxEventSource; ++ievent) indicesSource.push_back(ievent);
 
     // ---> target
-    m_log << Log::INFO << "PrepareIndices() : ---> target" << Log::endl();
-    m_indicesTarget = new std::vector<long>();
-    m_indicesTarget->reserve(maxEventTarget);
-    for (long ievent = 0; ievent < maxEventTarget; ++ievent) m_indicesTarget->push_back(ievent);
+    indicesTarget.reserve(maxEventTarget);
+    for (long ievent = 0; ievent < maxEventTarget; ++ievent) indicesTarget.push_back(ievent);
 
   }
 
-  // need to sort to optimise reading of TTree (TTree::GetEntry(index) reads in chunks of sequential data, so we don't want to jump around in indices...)
-  std::sort(m_indicesSource->begin(), m_indicesSource->end());
-  std::sort(m_indicesTarget->begin(), m_indicesTarget->end());
+}
 
-  //for (unsigned int i = 0; i < 101; ++i) std::cout << i << " " << m_indicesSource->at(i) << " " << m_indicesTarget->at(i) << std::endl;
-  
-  m_log << Log::INFO << "PrepareIndices() : Sorted vector of indices created!" << Log::endl();
+
+void Algorithm::DrawMultiplicities(const EventCache * cache, double sumWeights, long nDraws, Philox & random, std::vector<unsigned char> & multiplicities) const
+{
+
+  // draw multiplicities by inversion (the mean is around SamplingFraction for most events, so this takes few steps)
+  const unsigned int maxMultiplicity = std::numeric_limits<unsigned char>::max();
+  long nTruncated = 0;
+  const float * weights = cache->Weights();
+  long maxEvent = cache->Entries();
+  long chunkSize = cache->ChunkSize(sizeof(unsigned char));
+  multiplicities.resize(maxEvent);
+  for (long ievent = 0; ievent < maxEvent; ++ievent) {
+    double mean = weights[ievent] > 0 ? nDraws*weights[ievent]/sumWeights : 0.;
+    double p = std::exp(-mean);
+    double sum = p;
+    double u = random.Rndm();
+    unsigned int k = 0;
+    while ( u > sum && k < maxMultiplicity ) {
+      ++k;
+      p   *= mean/k;
+      sum += p;
+    }
+    if ( k == maxMultiplicity ) ++nTruncated;
+    multiplicities[ievent] = k;
+    if ( (ievent + 1) % chunkSize == 0 ) cache->Release(ievent + 1 - chunkSize, ievent + 1);
+  }
+  cache->Release(maxEvent - maxEvent % chunkSize, maxEvent);
+
+  // multiplicities are stored in one byte
+  if ( nTruncated > 0 ) {
+    std::lock_guard<std::mutex> lock(m_logMutex);
+    m_log << Log::WARNING << "DrawMultiplicities() : Multiplicity of " << nTruncated << " events (" << cache->Name() << ") truncated to " << maxMultiplicity << Log::endl();
+  }
 
 }
 
 
-int Algorithm::BinarySearchIndex(const std::vector<float> & cDist , float cVal, int l, int r) const
+void Algorithm::GrowForest(Forest * forest, int ntree, const HistDefs * histDefs)
 {
 
-  // check if left/right are valid
-  if (l < 0 || r > (int)cDist.size() - 1 || r < l) {
-    m_log << Log::ERROR << "BinarySearchIndex() : Something went wrong:  l = " << l << ", r = " << r << "cDist.size() = " << cDist.size() << Log::endl();
-    throw(0);
+  // get number of threads, and check if trees should be grown in parallel
+  int nThreads = 1;
+  Config::Instance().getif<int>("NumberOfThreads", nThreads);
+  bool parallelTrees = false;
+  Config::Instance().getif<bool>("ParallelTrees", parallelTrees);
+  if ( parallelTrees && Communicator::Instance().Size() > 1 ) {
+    m_log << Log::WARNING << "GrowForest() : 'ParallelTrees' is ignored with several processes (they exchange histograms tree by tree)" << Log::endl();
+    parallelTrees = false;
+  }
+
+  // the random number streams (used for bagging, feature sampling and random splits) are keyed by the tree index, so the result doesn't depend on the order the trees are grown in
+  int samplingFractionSeed = Config::Instance().get<float>("SamplingFractionSeed");
+
+  // declare trees and their histograms (filled in any order, but added to the forest and HistService in order of itree)
+  std::vector<DecisionTree *> trees(ntree, 0);
+  std::vector<std::vector<TH1F *> > hists(ntree);
+  auto growTree = [&](int itree, int nThreadsTree) {
+    Context context(m_cacheSource, m_cacheTarget, histDefs, samplingFractionSeed);
+    context.SetTreeIndex(itree);
+    trees[itree] = GrowTree(context, nThreadsTree);
+    hists[itree] = context.TakeHists();
+  };
+  
+  if ( parallelTrees && nThreads > 1 && ntree > 1 ) {
+
+    // one tree per thread at a time (the nodes of each tree are filled by a single thread)
+    nThreads = std::min(nThreads, ntree);
+    m_log << Log::INFO << "GrowForest() : Growing " << ntree << " trees using " << nThreads << " threads" << Log::endl();
+
+    // make ROOT thread-aware, and don't register the node histograms in the current directory
+    ROOT::EnableThreadSafety();
+    TH1::AddDirectory(false);
+
+    // worker threads pick the next tree to grow until all are done (the first exception is passed on to the main thread)
+    std::atomic<int> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    std::vector<std::thread> threads;
+    for (int ithread = 0; ithread < nThreads; ++ithread) {
+      threads.push_back(std::thread([&]() {
+	    for (int itree = next++; itree < ntree; itree = next++) {
+	      try {
+		growTree(itree, 1);
+	      }
+	      catch (...) {
+		std::lock_guard<std::mutex> lock(errorMutex);
+		if ( ! error ) error = std::current_exception();
+		next = ntree;
+	      }
+	    }
+	  }));
+    }
+    for (std::thread & thread : threads) thread.join();
+    if ( error ) {
+      for (DecisionTree * tree : trees) delete tree;
+      for (const std::vector<TH1F *> & treeHists : hists) for (TH1F * hist : treeHists) delete hist;
+      std::rethrow_exception(error);
+    }
+    
   }
+  else {
+
+    // one tree after the other
+    for (int itree = 0; itree < ntree; ++itree) growTree(itree, nThreads);
 
-  // print debug
-  //m_log << Log::DEBUG << "BinarySearchIndex() : Searching --> cVal = " << cVal << ", cDist[" << l << "] = " << cDist[l] << ", cDist[" << r << "] = " << cDist[r] <<Log::endl();
+  }
+
+  // add trees to forest, and their histograms to HistService
+  for (DecisionTree * tree : trees) forest->AddTree( tree );
+  for (const std::vector<TH1F *> & treeHists : hists) for (TH1F * hist : treeHists) HistService::Instance().AddHist(hist);
   
-  // continue search if not done
-  if (r - l  > 1) {
+}
+
+
+void Algorithm::GetWeight(float & weight, float & error) const
+{
+
+  // get variables of current event
+  m_features.resize(Variables::Get().size());
+  Variables::GetValues(m_features.data());
 
-    // get index for mid-point
-    int mid = l + (r - l)/2;
+  // get weight
+  GetWeights(m_features.data(), 1, &weight, &error);
 
-    // check if cVal is at 'mid' element (a somewhat pathological case)
-    if (cDist[mid] == cVal) {
-      //m_log << Log::DEBUG << "BinarySearchIndex() : Search done (index = " << mid <<") --> cVal = " << cVal << ", cDist[" << l << "] = " << cDist[l] << ", cDist[" << r << "] = " << cDist[r] << ", cDist[" << mid << "] = " << cDist[mid] <<Log::endl();
-      return mid;
+}
+
+
+void Algorithm::GetWeight(const float * features, float & weight, float & error) const
+{
+
+  GetWeights(features, 1, &weight, &error);
+
+}
+
+
+void Algorithm::AverageTrees(const std::vector<const Forest *> & forests, const float * features, long nEvents, float * weights, float * errors) const
+{
+
+  // get number of variables and total number of trees
+  unsigned int nVariables = Variables::Get().size();
+  int nTreeTotal = 0;
+  for (const Forest * forest : forests) {
+    nTreeTotal += forest->GetTrees().size();
+  }
+
+  // scratch space for one block of events (mean and variance over the trees are accumulated with Welford's method)
+  static thread_local std::vector<float> treeWeights;
+  float  sum[BLOCKSIZE];
+  double mean[BLOCKSIZE];
+  double m2[BLOCKSIZE];
+
+  // loop over blocks of events
+  for (long first = 0; first < nEvents; first += BLOCKSIZE) {
+    int n = std::min<long>(BLOCKSIZE, nEvents - first);
+    const float * block = features + first*nVariables;
+    for (int i = 0; i < n; ++i) {
+      sum[i]  = 0;
+      mean[i] = 0;
+      m2[i]   = 0;
     }
-    
-    // check if cVal is in left subarray
-    if (cDist[mid] > cVal) return BinarySearchIndex(cDist, cVal, l, mid);
-    
-    // otherwise, cVal is in right subarray
-    return BinarySearchIndex(cDist, cVal, mid, r);
 
+    // loop over all trees of all forests (each tree walks the events of the block one at a time, or QuickScorer scores
+    // them feature by feature, so only the accumulation over the trees is vectorised)
+    int iTree = 0;
+    for (const Forest * forest : forests) {
+      unsigned int nTrees = forest->GetTrees().size();
+      treeWeights.resize(nTrees*BLOCKSIZE);
+      forest->GetTreeWeights(block, nVariables, n, treeWeights.data());
+      for (unsigned int itree = 0; itree < nTrees; ++itree) {
+        const float * treeWeight = &treeWeights[itree*n];
+        ++iTree;
+        for (int i = 0; i < n; ++i) {
+          sum[i] += treeWeight[i];
+          double delta = treeWeight[i] - mean[i];
+          mean[i] += delta/iTree;
+          m2[i]   += delta*(treeWeight[i] - mean[i]);
+        }
+      }
+    }
+
+    // finalise weight/error
+    for (int i = 0; i < n; ++i) {
+      weights[first + i] = sum[i]/static_cast<float>( nTreeTotal );
+      errors[first + i]  = std::sqrt( m2[i]/( nTreeTotal > 1 ? nTreeTotal - 1 : 1 ) );
+    }
+  }
+
+}
+
+
+void Algorithm::Normalize()
+{
+
+  m_normalization = GetNormalization();
+
+}
+
+
+float Algorithm::Normalization() const
+{
+
+  if ( m_normalization < 0 ) {
+    m_log << Log::ERROR << "Normalization() : Normalization isn't available (call Normalize() first)" << Log::endl();
+    throw(0);
   }
 
-  // r - l <= 1 : we're done - return upper index
-  //m_log << Log::DEBUG << "BinarySearchIndex() : Search done (index = " << r <<") --> cVal = " << cVal << ", cDist[" << l << "] = " << cDist[l] << ", cDist[" << r << "] = " << cDist[r] <<Log::endl();
-  return r;
+  return m_normalization;
 
 }
 
@@ -179,19 +458,38 @@ float Algorithm::GetNormalization() const
   m_log << Log::INFO << "GetNormalization() : Getting normalization (target/source)" << Log::endl();
   double sumWSourceTot = 0;
   double sumWTargetTot = 0;
-  static const std::string & eventWeightName = Config::Instance().get<std::string>("EventWeightVariableName");
-  static const float & eventWeight = Event::Instance().get<float>(eventWeightName);
-  for (long ievent = 0; ievent < m_source->GetEntries(); ++ievent) {
-    m_source->GetEntry( ievent );
-    float MLw = 1;
-    float MLe = 0;
-    GetWeight(MLw,MLe);
-    sumWSourceTot += eventWeight*MLw;
-  }
-  for (long ievent = 0; ievent < m_target->GetEntries(); ++ievent) {
-    m_target->GetEntry( ievent );
-    sumWTargetTot += eventWeight;
+  unsigned int nVariables = Variables::Get().size();
+  std::vector<float> features(BLOCKSIZE*nVariables);
+  float MLw[BLOCKSIZE];
+  float MLe[BLOCKSIZE];
+  long chunkSize = m_cacheSource->ChunkSize();
+  long chunkFirst = 0;
+  for (long first = 0; first < m_cacheSource->Entries(); first += BLOCKSIZE) {
+    int nEvents = std::min<long>(BLOCKSIZE, m_cacheSource->Entries() - first);
+    for (int i = 0; i < nEvents; ++i) {
+      for (unsigned int ivar = 0; ivar < nVariables; ++ivar) features[i*nVariables + ivar] = m_cacheSource->Value(ivar, first + i);
+    }
+    GetWeights(features.data(), nEvents, MLw, MLe);
+    for (int i = 0; i < nEvents; ++i) {
+      sumWSourceTot += m_cacheSource->Weight( first + i )*MLw[i];
+    }
+    if ( first + nEvents - chunkFirst >= chunkSize ) {
+      m_cacheSource->Release(chunkFirst, first + nEvents);
+      chunkFirst = first + nEvents;
+    }
+  }
+  m_cacheSource->Release(chunkFirst, m_cacheSource->Entries());
+  chunkSize = m_cacheTarget->ChunkSize();
+  for (long ievent = 0; ievent < m_cacheTarget->Entries(); ++ievent) {
+    sumWTargetTot += m_cacheTarget->Weight( ievent );
+    if ( (ievent + 1) % chunkSize == 0 ) m_cacheTarget->Release(ievent + 1 - chunkSize, ievent + 1);
   }
+  m_cacheTarget->Release(m_cacheTarget->Entries() - m_cacheTarget->Entries() % chunkSize, m_cacheTarget->Entries());
+  // add up the sums of all event shards
+  double sums[2] = {sumWSourceTot, sumWTargetTot};
+  Communicator::Instance().AllReduceShards(sums, 2);
+  sumWSourceTot = sums[0];
+  sumWTargetTot = sums[1];
   if (sumWSourceTot <= 0 || sumWTargetTot <= 0) {
     m_log << Log::ERROR << "GetNormalization() : sumWSourceTot = " << sumWSourceTot << ", sumWTargetTot = " << sumWTargetTot << Log::endl();
     throw(0);
@@ -0,0 +1,98 @@
+// local includes
+#include "AliasTable.h"
+#include "Config.h"
+
+// stl includes
+#include <limits>
+
+
+AliasTable::AliasTable() :
+  m_probability(),
+  m_alias(),
+  m_log("AliasTable")
+{
+
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+}
+
+
+void AliasTable::Build(const float * weights, unsigned long n)
+{
+
+  // check number of events
+  if ( n == 0 || n > std::numeric_limits<unsigned int>::max() ) {
+    m_log << Log::ERROR << "Build() : Can't build table for " << n << " events" << Log::endl();
+    throw(0);
+  }
+
+  // get sum of weights
+  double sum = 0;
+  long nNegative = 0;
+  for (unsigned long i = 0; i < n; ++i) {
+    if ( weights[i] > 0 ) sum += weights[i];
+    else if ( weights[i] < 0 ) ++nNegative;
+  }
+  if ( ! (sum > 0) ) {
+    m_log << Log::ERROR << "Build() : Sum of event weights is not positive!" << Log::endl();
+    throw(0);
+  }
+  if ( nNegative > 0 ) {
+    m_log << Log::WARNING << "Build() : " << nNegative << " events with negative weights will never be drawn" << Log::endl();
+  }
+
+  // scale weights to mean 1, and split buckets into those below and above the mean (Vose's method)
+  std::vector<double> scaled(n);
+  std::vector<unsigned int> small;
+  std::vector<unsigned int> large;
+  for (unsigned long i = 0; i < n; ++i) {
+    scaled[i] = weights[i] > 0 ? weights[i]*n/sum : 0.;
+    if ( scaled[i] < 1 ) small.push_back(i);
+    else                 large.push_back(i);
+  }
+
+  // fill each small bucket up to 1 with the probability of a large one
+  m_probability.assign(n, 1.f);
+  m_alias.resize(n);
+  for (unsigned long i = 0; i < n; ++i) m_alias[i] = i;
+  while ( ! small.empty() && ! large.empty() ) {
+    unsigned int s = small.back();
+    unsigned int l = large.back();
+    small.pop_back();
+    m_probability[s] = scaled[s];
+    m_alias[s] = l;
+    scaled[l] -= 1. - scaled[s];
+    if ( scaled[l] < 1 ) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // remaining buckets are full (up to rounding)
+  for (unsigned int i : small) m_probability[i] = 1;
+  for (unsigned int i : large) m_probability[i] = 1;
+
+}
+
+
+void AliasTable::DrawSorted(long n, Philox & random, std::vector<long> & indices) const
+{
+
+  // count how often each index is drawn
+  std::vector<unsigned int> counts(m_probability.size(), 0);
+  for (long i = 0; i < n; ++i) ++counts[ Draw(random) ];
+
+  // write indices in ascending order (counting sort)
+  indices.clear();
+  indices.reserve(n);
+  for (unsigned long index = 0; index < counts.size(); ++index) {
+    for (unsigned int count = counts[index]; count > 0; --count) indices.push_back(index);
+  }
+
+}
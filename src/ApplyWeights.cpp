@@ -10,18 +10,26 @@
 #include "Config.h"
 #include "Log.h"
 #include "Method.h"
+#include "EventReader.h"
 
 // stl includes
 #include <vector>
 #include <string>
 #include <fstream>
-#include <ctime>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <stdexcept>
 #include <algorithm>
 #include <utility>
 
 // ROOT includes
 #include "TFile.h"
 #include "TTree.h"
+#include "TROOT.h"
 
 
 
@@ -58,17 +66,25 @@ int main(int argc, char * argv[]) {
   }
   Method::TYPE method = Method::Type(str_method);
 
-  // declare/run algorithm
+  // read forests
   std::string weightsFileName = Config::Instance().get<std::string>("WeightsFileName");
+  const std::vector<const Forest *> forests = Forest::ReadForests(weightsFileName);
+
+  // evaluate with the compiled trees of a library generated by CompileForest (optional)
+  std::string compiledLibrary;
+  Config::Instance().getif<std::string>("CompiledForestLibrary", compiledLibrary);
+  if ( compiledLibrary.length() > 0 ) Forest::LoadCompiled(forests, compiledLibrary);
+
+  // declare algorithm
   Algorithm * algorithm = 0;
   if ( method == Method::BDT ) {
-    algorithm = new BDT( Forest::ReadForests(weightsFileName) );
+    algorithm = new BDT( forests );
   }
   else if ( method == Method::RF ) {
-    algorithm = new RandomForest( Forest::ReadForests(weightsFileName) );
+    algorithm = new RandomForest( forests );
   }
   else if ( method == Method::ET ) {
-    algorithm = new ExtraTrees( Forest::ReadForests(weightsFileName) );
+    algorithm = new ExtraTrees( forests );
   }
   else {
     log << Log::ERROR << "Couldn't recognize method!" << Log::endl();
@@ -107,37 +123,192 @@ int main(int argc, char * argv[]) {
   TBranch * b_weight_err = 0;
   b_weight_err = source->Branch(weightErrName.c_str(), &weight_err);
   
+  // number of threads (worker threads read their own TTree handle, the weights are written by the main thread between windows)
+  int nThreads = 1;
+  Config::Instance().getif<int>("NumberOfThreads", nThreads);
+
+  // buffers for a batch of events (the weights of a batch are evaluated together)
+  const long batchSize = 16*Algorithm::BLOCKSIZE;
+  unsigned int nVariables = Variables::Get().size();
+
   // prepare for loop over tree entries
   long maxEvent = source->GetEntries();
   long reportFrac = maxEvent/(maxEvent > 100000 ? 100 : 1) + 1;
-  log << Log::INFO << "Looping over events (" << source->GetName() << ") : "  << maxEvent << Log::endl();
-  std::clock_t start = std::clock();
-
-  // Loop over ree entries
-  for (long ievent = 0; ievent < maxEvent; ++ievent) {
-
-    // print progress
-    if( ievent > 0 && ievent % reportFrac == 0 ) {
-      double duration     = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
-      double frequency    = static_cast<double>(ievent) / duration;
-      double timeEstimate = static_cast<double>(maxEvent - ievent) / frequency;
-      log << Log::INFO << "---> processed : " << std::setw(8) << 100*ievent/maxEvent << "\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time : " << std::setw(4) << static_cast<int>(timeEstimate) << " sec"<< Log::endl(); 
+  log << Log::INFO << "Looping over events (" << source->GetName() << ") : "  << maxEvent << (nThreads > 1 ? " using " + std::to_string(nThreads) + " threads" : "") << Log::endl();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  long nextReport = reportFrac;
+  auto printProgress = [&](long processed) {
+    double duration     = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double frequency    = static_cast<double>(processed) / duration;
+    double timeEstimate = static_cast<double>(maxEvent - processed) / frequency;
+    log << Log::INFO << "---> processed : " << std::setw(8) << 100*processed/maxEvent << "\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time : " << std::setw(4) << static_cast<int>(timeEstimate) << " sec"<< Log::endl(); 
+  };
+
+  // serial loop over batches of tree entries
+  if ( nThreads <= 1 ) {
+
+    std::vector<float> features(batchSize*nVariables);
+    std::vector<float> weights(batchSize);
+    std::vector<float> errors(batchSize);
+    for (long first = 0; first < maxEvent; first += batchSize) {
+      long nEvents = std::min(batchSize, maxEvent - first);
+
+      // print progress
+      if ( first >= nextReport ) {
+        printProgress(first);
+        nextReport += reportFrac*((first - nextReport)/reportFrac + 1);
+      }
+
+      // get events
+      for (long i = 0; i < nEvents; ++i) {
+        source->GetEntry( first + i );
+        Variables::GetValues(&features[i*nVariables]);
+      }
+
+      // get weights/errors
+      algorithm->GetWeights(features.data(), nEvents, weights.data(), errors.data());
+
+      // fill output branches
+      for (long i = 0; i < nEvents; ++i) {
+        weight     = weights[i];
+        weight_err = errors[i];
+        b_weight->Fill();
+        b_weight_err->Fill();
+      }
+
+    }
+
+  }
+
+  // parallel loop over windows of ranges of whole clusters
+  else {
+
+    // the workers read the input file through their own read-only handles, so nothing may be written to it while they
+    // run: a window of ranges is evaluated in parallel, then the workers wait while the main thread fills its weights
+    ROOT::EnableThreadSafety();
+
+    // split entries into ranges of whole clusters (a few ranges per thread, so that all threads stay busy, but bounded in size)
+    std::vector<long> rangeEdges(1, 0);
+    long rangeSize = std::min(maxEvent/(4*nThreads) + 1, 64*batchSize);
+    TTree::TClusterIterator clusters = source->GetClusterIterator(0);
+    while ( clusters.Next() < maxEvent ) {
+      long next = clusters.GetNextEntry();
+      if ( next - rangeEdges.back() >= rangeSize || next >= maxEvent ) rangeEdges.push_back(next);
+    }
+    int nRanges = rangeEdges.size() - 1;
+
+    // windows of ranges (the weights are only kept for the events of one window)
+    const int windowRanges = 2*nThreads;
+    long windowSize = 0;
+    for (int irange = 0; irange < nRanges; irange += windowRanges) {
+      windowSize = std::max(windowSize, rangeEdges[std::min(irange + windowRanges, nRanges)] - rangeEdges[irange]);
+    }
+    std::vector<float> weights(windowSize);
+    std::vector<float> errors(windowSize);
+
+    // current window, and state of the workers (only the main thread logs)
+    int windowLast = 0;
+    long windowStart = 0;
+    int generation = 0;
+    bool finished = false;
+    std::atomic<int> nextRange(0);
+    int nIdle = 0;
+    long nProcessed = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::exception_ptr exception;
+
+    // worker: read and evaluate the ranges of each window (errors are passed on to the main thread with the exception)
+    auto worker = [&]() {
+      try {
+        TFile file(inputfilename.c_str(), "read");
+        TTree * tree = file.IsOpen() ? static_cast<TTree *>(file.Get(treenamesource.c_str())) : 0;
+        if ( ! tree ) throw std::runtime_error("Couldn't get TTree : " + treenamesource + " in worker thread");
+        EventReader reader(tree);
+        std::vector<float> features(batchSize*nVariables);
+        for (int seen = 0; ; ) {
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            ++nIdle;
+            condition.notify_all();
+            condition.wait(lock, [&]() { return generation != seen || finished; });
+            if ( finished ) return;
+            seen = generation;
+          }
+          for (int irange = nextRange++; irange < windowLast; irange = nextRange++) {
+            long first = rangeEdges[irange];
+            long nEntries = rangeEdges[irange + 1] - first;
+            for (long offset = 0; offset < nEntries; offset += batchSize) {
+              long nEvents = std::min(batchSize, nEntries - offset);
+              for (long i = 0; i < nEvents; ++i) {
+                reader.GetEntry( first + offset + i );
+                reader.GetValues(&features[i*nVariables]);
+              }
+              algorithm->GetWeights(features.data(), nEvents, &weights[first + offset - windowStart], &errors[first + offset - windowStart]);
+            }
+            {
+              std::lock_guard<std::mutex> lock(mutex);
+              nProcessed += nEntries;
+            }
+            condition.notify_all();
+          }
+        }
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if ( ! exception ) exception = std::current_exception();
+        nextRange = nRanges;
+        condition.notify_all();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int ithread = 0; ithread < nThreads; ++ithread) threads.emplace_back(worker);
+
+    // loop over windows: start the workers, wait until all of them are idle again (printing progress), and fill the window
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&]() { return nIdle == nThreads || exception; });
+    for (int windowFirst = 0; windowFirst < nRanges && ! exception; windowFirst = windowLast) {
+      windowLast  = std::min(windowFirst + windowRanges, nRanges);
+      windowStart = rangeEdges[windowFirst];
+      nextRange   = windowFirst;
+      nIdle       = 0;
+      ++generation;
+      condition.notify_all();
+      while ( nIdle < nThreads && ! exception ) {
+        condition.wait(lock);
+        if ( nProcessed >= nextReport && nProcessed < maxEvent ) {
+          printProgress(nProcessed);
+          nextReport += reportFrac*((nProcessed - nextReport)/reportFrac + 1);
+        }
+      }
+      if ( exception ) break;
+
+      // fill output branches in entry order (all workers are waiting)
+      for (long ievent = windowStart; ievent < rangeEdges[windowLast]; ++ievent) {
+        weight     = weights[ievent - windowStart];
+        weight_err = errors[ievent - windowStart];
+        b_weight->Fill();
+        b_weight_err->Fill();
+      }
+    }
+    finished = true;
+    condition.notify_all();
+    lock.unlock();
+    for (std::thread & thread : threads) thread.join();
+    if ( exception ) {
+      try {
+        std::rethrow_exception(exception);
+      }
+      catch (const std::runtime_error & error) {
+        log << Log::ERROR << error.what() << Log::endl();
+        throw(0);
+      }
     }
-    
-    // get event
-    source->GetEntry( ievent );
 
-    // get weight/error
-    algorithm->GetWeight(weight, weight_err);
-    
-    // fill output branches
-    b_weight->Fill();
-    b_weight_err->Fill();
-    
   }
 
   // print out
-  double duration  = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
+  double duration  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
   double frequency = static_cast<double>(maxEvent) / duration;
   log << Log::INFO << "---> processed : " << std::setw(8) << 100 << "\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time :    0 sec"<< Log::endl(); 
 
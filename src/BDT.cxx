@@ -4,9 +4,13 @@
 #include "DecisionTree.h"
 #include "Config.h"
 #include "HistDefs.h"
+#include "EventCache.h"
+#include "Variables.h"
+#include "Context.h"
 
 // stl includes
 #include <vector>
+#include <algorithm>
 
 // ROOT includes
 #include "TTree.h"
@@ -15,6 +19,8 @@
 
 BDT::BDT(TTree * source, TTree * target) :
   Algorithm(source, target),
+  m_histDefs(0),
+  m_context(0),
   m_log("BDT")
 {
   
@@ -32,6 +38,8 @@ BDT::BDT(TTree * source, TTree * target) :
 
 BDT::BDT(std::vector<const Forest *> forests) :
   Algorithm(),
+  m_histDefs(0),
+  m_context(0),
   m_forests(forests),
   m_log("BDT")
 {
@@ -50,6 +58,8 @@ BDT::BDT(std::vector<const Forest *> forests) :
 
 BDT::~BDT()
 {
+
+  delete m_context;
  
 }
 
@@ -57,24 +67,39 @@ BDT::~BDT()
 void BDT::Initialize()
 {
 
-  // prepare event indices
-  static bool bagging = false;
-  Config::Instance().getif<bool>("Bagging", bagging); 
-  if ( ! bagging ) Algorithm::PrepareIndices();
-  
+  // read source and target events into memory
+  Algorithm::FillCache();
+
   // get histogram definitions
   m_histDefs = new HistDefs;
   m_histDefs->Initialize();
-  m_histDefs->UpdateVariableRanges(m_target);
-  m_histDefs->UpdateVariableRanges(m_source);
+  m_histDefs->UpdateVariableRanges(m_cacheTarget);
+  m_histDefs->UpdateVariableRanges(m_cacheSource);
+  m_cacheTarget->Quantize(m_histDefs);
+  m_cacheSource->Quantize(m_histDefs);
   for (const HistDefs::Entry & entry : m_histDefs->GetEntries()) {
     m_log << Log::INFO << "BDT() : Histogram name : " << entry.Name() << ", range = ( " << entry.Xmin() << " , " << entry.Xmax() << " )" << Log::endl();
   }
 
-  // initialize weights
-  m_weights.resize( m_source->GetEntries() );
-  for (unsigned int i = 0; i < m_weights.size(); ++i) {
-    m_weights.at(i) = 1.0;
+  // create training context (the random number streams are only used for bagging)
+  bool bagging = false;
+  Config::Instance().getif<bool>("Bagging", bagging); 
+  int samplingFractionSeed = bagging ? Config::Instance().get<float>("SamplingFractionSeed") : 0;
+  delete m_context;
+  m_context = new Context(m_cacheSource, m_cacheTarget, m_histDefs, samplingFractionSeed);
+
+  // prepare event indices
+  if ( ! bagging ) Algorithm::PrepareIndices(*m_context);
+
+  // initialize weights (in a scratch file if there is a 'MemoryBudget')
+  long maxEvent = m_cacheSource->Entries();
+  long chunkSize = m_cacheSource->ChunkSize(sizeof(float));
+  m_weights.Allocate(maxEvent*sizeof(float), ScratchBuffer::Directory());
+  float * weights = m_weights.Data<float>();
+  for (long first = 0; first < maxEvent; first += chunkSize) {
+    long last = std::min(first + chunkSize, maxEvent);
+    for (long i = first; i < last; ++i) weights[i] = 1.0;
+    m_weights.Release(first*sizeof(float), (last - first)*sizeof(float));
   }
 
 }
@@ -86,21 +111,15 @@ void BDT::Process()
   // declare forest
   Forest * forest = new Forest;
   
-  // grow decision trees
+  // grow decision trees (one after the other, since each tree depends on the weights from the previous ones)
   int ntree = Config::Instance().get<int>("NumberOfTrees");
+  int nThreads = 1;
+  Config::Instance().getif<int>("NumberOfThreads", nThreads);
   for (int itree = 0; itree < ntree; ++itree) {
 
-    // bagging
-    static bool bagging = false;
-    Config::Instance().getif<bool>("Bagging", bagging); 
-    if ( bagging ) Algorithm::PrepareIndices();
-
-    // create tree
-    DecisionTree * dtree = new DecisionTree(m_source, m_target, m_indicesSource, m_indicesTarget, m_histDefs);
-    dtree->GrowTree( &m_weights );
-    
     // add tree to forest
-    forest->AddTree( dtree );
+    m_context->SetTreeIndex(itree);
+    forest->AddTree( GrowTree(*m_context, nThreads) );
 
   }
   
@@ -111,67 +130,92 @@ void BDT::Process()
 }
 
 
+DecisionTree * BDT::GrowTree(Context & context, int nThreads)
+{
+
+  // bagging
+  bool bagging = false;
+  Config::Instance().getif<bool>("Bagging", bagging); 
+  if ( bagging ) Algorithm::PrepareIndices(context);
+
+  // create tree
+  DecisionTree * dtree = new DecisionTree(context);
+  dtree->SetNumberOfThreads(nThreads);
+  dtree->GrowTree( &m_weights );
+
+  return dtree;
+
+}
+
+
 void BDT::Write(std::ofstream & outfile) {
 
   // get first forest (in 'calculate' mode, there is only one forest)
   const std::vector<const DecisionTree *> & decisionTrees = m_forests.at(0)->GetTrees();
 
   // write trees to file
-  float norm = GetNormalization();
-  for (const DecisionTree * dtree : decisionTrees) {
-    static bool writeNorm = true;
-    if ( writeNorm ) {
-      writeNorm = false;
-      dtree->Write( outfile, norm );
-    }
-    else {
-      dtree->Write( outfile );
-    }
+  float norm = Normalization();
+  for (unsigned int itree = 0; itree < decisionTrees.size(); ++itree) {
+    decisionTrees[itree]->Write( outfile, itree, itree == 0 ? norm : 1 );
   }
 
 }
 
 
-void BDT::GetWeight(float & weight, float & error) const
+void BDT::GetWeights(const float * features, long nEvents, float * weights, float * errors) const
 {
 
-  // reset weight/error
-  weight = 0;
-  error  = 0;
-
-  // get number of forests
+  // get number of variables and forests
+  unsigned int nVariables = Variables::Get().size();
   int nForest = m_forests.size();
-  
-  // declare vector to hold error from each forest
-  std::vector<float> error_vec( nForest );
-
-  // loop over forests
-  int iForest = 0;
-  for (const Forest * forest : m_forests) {
-
-    // loop over trees
-    const std::vector<const DecisionTree *> & trees = forest->GetTrees();
-    
-    // multiply weights from the trees in the forest
-    float w = 1;
-    for (const DecisionTree * t : trees) {
-      w *= t->GetWeight();
+
+  // scratch space for one block of events (mean and variance over the forests are accumulated with Welford's method)
+  static thread_local std::vector<float> treeWeights;
+  float  forestWeight[BLOCKSIZE];
+  float  sum[BLOCKSIZE];
+  double mean[BLOCKSIZE];
+  double m2[BLOCKSIZE];
+
+  // loop over blocks of events
+  for (long first = 0; first < nEvents; first += BLOCKSIZE) {
+    int n = std::min<long>(BLOCKSIZE, nEvents - first);
+    const float * block = features + first*nVariables;
+    for (int i = 0; i < n; ++i) {
+      sum[i]  = 0;
+      mean[i] = 0;
+      m2[i]   = 0;
     }
-    weight += w;
-    error_vec.at( iForest ) = w;
-    
-    // increment iForest
-    ++iForest;
 
-  }
-  
-  // finalise weight
-  weight /= static_cast<float>( nForest );
+    // loop over forests
+    int iForest = 0;
+    for (const Forest * forest : m_forests) {
+
+      // multiply weights from the trees in the forest
+      unsigned int nTrees = forest->GetTrees().size();
+      treeWeights.resize(nTrees*BLOCKSIZE);
+      forest->GetTreeWeights(block, nVariables, n, treeWeights.data());
+      for (int i = 0; i < n; ++i) forestWeight[i] = 1;
+      for (unsigned int itree = 0; itree < nTrees; ++itree) {
+        const float * treeWeight = &treeWeights[itree*n];
+        for (int i = 0; i < n; ++i) forestWeight[i] *= treeWeight[i];
+      }
+
+      // accumulate mean and variance
+      ++iForest;
+      for (int i = 0; i < n; ++i) {
+        sum[i] += forestWeight[i];
+        double delta = forestWeight[i] - mean[i];
+        mean[i] += delta/iForest;
+        m2[i]   += delta*(forestWeight[i] - mean[i]);
+      }
+
+    }
 
-  // finalise error
-  for (float e : error_vec) {
-    error += pow(e - weight, 2);
+    // finalise weight/error
+    for (int i = 0; i < n; ++i) {
+      weights[first + i] = sum[i]/static_cast<float>( nForest );
+      errors[first + i]  = sqrt( m2[i]/( nForest > 1 ? nForest - 1 : 1 ) );
+    }
   }
-  error = sqrt( error/( nForest > 1 ? nForest - 1 : 1 ) );
-  
+
 }
@@ -0,0 +1,131 @@
+//local includes
+#include "Algorithm.h"
+#include "Forest.h"
+#include "DecisionTree.h"
+#include "QuickScorer.h"
+#include "Variables.h"
+#include "Config.h"
+#include "Log.h"
+
+// stl includes
+#include <vector>
+#include <string>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+// ROOT includes
+#include "TRandom3.h"
+
+
+
+int main(int argc, char * argv[]) {
+
+  // check number of arguments
+  if ( argc != 2 ) {
+    std::cout << "Provide 1 argument: ./bin/BenchmarkEvaluation <config-path>" << std::endl;
+    return 0;
+  }
+
+  // get confiuration file
+  std::string configpath = argv[1];
+  Config::Instance(configpath.c_str());
+
+  // initialize log
+  Log log("BenchmarkEvaluation");
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    log.SetLevel(level);
+  }
+
+  // initialize variables (needs to be done before reading the weights)
+  Variables::Initialize();
+
+  // read forests
+  std::string weightsFileName = Config::Instance().get<std::string>("WeightsFileName");
+  const std::vector<const Forest *> forests = Forest::ReadForests(weightsFileName);
+
+  // range of the cuts on each variable
+  unsigned int nVariables = Variables::Get().size();
+  std::vector<float> xmin(nVariables, std::numeric_limits<float>::max());
+  std::vector<float> xmax(nVariables, -std::numeric_limits<float>::max());
+  for (const Forest * forest : forests) {
+    for (const DecisionTree * tree : forest->GetTrees()) {
+      for (unsigned int inode = 0; inode < tree->NumberOfFlatNodes(); ++inode) {
+	const DecisionTree::FlatNode & node = tree->FlatNodes()[inode];
+	xmin[node.variable] = std::min(xmin[node.variable], node.cutValue);
+	xmax[node.variable] = std::max(xmax[node.variable], node.cutValue);
+      }
+    }
+  }
+
+  // generate events uniformly around the range of the cuts
+  int nEvents = 1000000;
+  Config::Instance().getif<int>("BenchmarkEvents", nEvents);
+  TRandom3 ran(1);
+  std::vector<float> features(nEvents*nVariables);
+  for (long ievent = 0; ievent < nEvents; ++ievent) {
+    for (unsigned int ivar = 0; ivar < nVariables; ++ivar) {
+      float margin = xmin[ivar] <= xmax[ivar] ? 0.1*(xmax[ivar] - xmin[ivar]) + 1 : 1;
+      float low    = xmin[ivar] <= xmax[ivar] ? xmin[ivar] - margin : -1;
+      float high   = xmin[ivar] <= xmax[ivar] ? xmax[ivar] + margin :  1;
+      features[ievent*nVariables + ivar] = ran.Uniform(low, high);
+    }
+  }
+  log << Log::INFO << "Evaluating " << nEvents << " events" << Log::endl();
+
+  // compare traversal of the flat trees with QuickScorer, forest by forest
+  const int blockSize = Algorithm::BLOCKSIZE;
+  for (unsigned int iforest = 0; iforest < forests.size(); ++iforest) {
+    const std::vector<const DecisionTree *> & trees = forests[iforest]->GetTrees();
+    if ( ! QuickScorer::Supports(trees) ) {
+      log << Log::WARNING << "Forest " << iforest << " has trees with more than " << QuickScorer::MAXLEAVES << " final nodes, skipping" << Log::endl();
+      continue;
+    }
+    QuickScorer quickScorer(trees);
+    std::vector<float> traversalWeights(trees.size()*blockSize);
+    std::vector<float> quickScorerWeights(trees.size()*blockSize);
+    double sumTraversal = 0;
+    double sumQuickScorer = 0;
+    double timeTraversal = 0;
+    double timeQuickScorer = 0;
+    long nDifferent = 0;
+    for (long first = 0; first < nEvents; first += blockSize) {
+      int n = std::min<long>(blockSize, nEvents - first);
+      const float * block = &features[first*nVariables];
+
+      // traversal
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (unsigned int itree = 0; itree < trees.size(); ++itree) {
+	trees[itree]->GetWeights(block, nVariables, n, &traversalWeights[itree*n]);
+      }
+      timeTraversal += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      // QuickScorer
+      start = std::chrono::steady_clock::now();
+      quickScorer.GetTreeWeights(block, nVariables, n, quickScorerWeights.data());
+      timeQuickScorer += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      // compare
+      for (unsigned int i = 0; i < trees.size()*n; ++i) {
+	sumTraversal   += traversalWeights[i];
+	sumQuickScorer += quickScorerWeights[i];
+	if ( traversalWeights[i] != quickScorerWeights[i] ) ++nDifferent;
+      }
+    }
+
+    // print out
+    log << Log::INFO << "Forest " << iforest << " (" << trees.size() << " trees) : traversal   : " << std::setw(10) << static_cast<long>(nEvents/timeTraversal) << " events/sec  ---  sum of tree weights : " << sumTraversal << Log::endl();
+    log << Log::INFO << "Forest " << iforest << " (" << trees.size() << " trees) : QuickScorer : " << std::setw(10) << static_cast<long>(nEvents/timeQuickScorer) << " events/sec  ---  sum of tree weights : " << sumQuickScorer << Log::endl();
+    if ( nDifferent > 0 ) {
+      log << Log::ERROR << "Forest " << iforest << " : " << nDifferent << " tree weights differ between traversal and QuickScorer" << Log::endl();
+      return 1;
+    }
+  }
+
+  // and we're done!
+  return 0;
+
+}
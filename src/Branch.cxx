@@ -2,50 +2,20 @@
 #include "Branch.h"
 #include "Node.h"
 #include "Event.h"
-#include "Variables.h"
-#include "Config.h"
+#include "EventCache.h"
 
 // stl includes
 #include <vector>
 #include <string>
 
 
-Branch::Branch(Node * input, const std::string & variableName, float cutValue, bool isGreater, float sumSource, float sumTarget) :
+Branch::Branch(Node * input, const Variable * variable, float cutValue, bool isGreater, float sumSource, float sumTarget, int cutBin) :
   m_input(input),
   m_output(0),
-  m_cut(0),
+  m_cut(variable, cutValue, isGreater, cutBin),
   m_sumSource(sumSource),
-  m_sumTarget(sumTarget),
-  m_log("Branch")
-{
-  
-  // set log's print level
-  std::string str_level;
-  Config::Instance().getif<std::string>("PrintLevel", str_level);
-  if (str_level.length() > 0) {
-    Log::LEVEL level = Log::StringToLEVEL(str_level);
-    m_log.SetLevel(level);
-  }
-
-  // get variable
-  const Variable * variable = Variables::Get(variableName);
-  
-  // initialize cut object
-  if ( isGreater ) m_cut = new Greater(variable, cutValue);
-  else             m_cut = new Smaller(variable, cutValue);
-
-}
-
-
-Branch::~Branch()
-{
-
-  //m_log << Log::INFO << "~Branch() : Called" << Log::endl();
-
-  delete m_cut;
-  m_cut = 0;
-  
-}
+  m_sumTarget(sumTarget)
+{}
 
 
 const Node * Branch::InputNode() const
@@ -75,20 +45,28 @@ void Branch::SetOutputNode(const Node * node)
 const std::string & Branch::VariableName() const
 {
 
-  return m_cut->GetVariable()->Name();
+  return m_cut.GetVariable()->Name();
+  
+}
+
+
+bool Branch::Pass(const float * features) const
+{
+
+  return m_cut.Pass(features);
   
 }
 
 
-bool Branch::Pass() const
+bool Branch::Pass(const EventCache * cache, long ievent) const
 {
 
-  return m_cut->Pass();
+  return m_cut.Pass(cache, ievent);
   
 }
 
 
-const Branch::Cut * Branch::CutObject() const
+const Branch::Cut & Branch::CutObject() const
 {
 
   return m_cut;
@@ -96,6 +74,14 @@ const Branch::Cut * Branch::CutObject() const
 }
 
 
+bool Branch::IsGreater() const
+{
+
+  return m_cut.IsGreater();
+
+}
+
+
 float Branch::SumSource() const
 {
 
@@ -110,3 +96,11 @@ float Branch::SumTarget() const
   return m_sumTarget;
   
 }
+
+
+bool Branch::Cut::Pass(const EventCache * cache, long ievent) const
+{
+
+  return (static_cast<int>(cache->Bin(m_variable->Index(), ievent)) >= m_cutBin) == m_isGreater;
+
+}
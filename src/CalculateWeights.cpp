@@ -1,5 +1,7 @@
 //local includes
 #include "Algorithm.h"
+#include "Forest.h"
+#include "DecisionTree.h"
 #include "BDT.h"
 #include "RandomForest.h"
 #include "ExtraTrees.h"
@@ -10,6 +12,7 @@
 #include "Log.h"
 #include "Method.h"
 #include "HistService.h"
+#include "Communicator.h"
 
 // stl includes
 #include <vector>
@@ -71,6 +74,14 @@ int main(int argc, char * argv[]) {
     }
   }
   
+  // start worker processes (data-parallel: each reads a shard of the events; feature-parallel: each reads all events, but
+  // only searches splits in its own variables), each process opens the input file itself
+  int nProcesses = 1;
+  bool featureParallel = false;
+  Config::Instance().getif<int>("NumberOfProcesses", nProcesses);
+  Config::Instance().getif<bool>("FeatureParallel", featureParallel);
+  Communicator::Instance().Start(nProcesses, featureParallel ? Communicator::FEATURE_PARALLEL : Communicator::DATA_PARALLEL);
+
   // get input file
   const std::string & inputFileName = Config::Instance().get<std::string>("InputFileName");
   TFile * f = new TFile(inputFileName.c_str(), "read");
@@ -119,6 +130,13 @@ int main(int argc, char * argv[]) {
   }
   algorithm->Initialize();
   algorithm->Process();
+  algorithm->Normalize();
+
+  // only the first process writes the output
+  if ( Communicator::Instance().Rank() > 0 ) {
+    Communicator::Instance().Finish();
+    return 0;
+  }
 
   // open ouput file
   std::string outfilename = "Weights.txt";
@@ -151,6 +169,16 @@ int main(int argc, char * argv[]) {
 
   // close file
   outfile.close();
+
+  // write binary copy of the weights next to the text file (read back from the text file, so both give the same weights)
+  // and delete the forests read back (forests don't own their trees)
+  const std::vector<const Forest *> forests = Forest::ReadForests(outfilename);
+  Forest::WriteBinary( forests, outfilename + ".bin" );
+  for (const Forest * forest : forests) {
+    std::vector<const DecisionTree *> trees = forest->GetTrees();
+    delete forest;
+    for (const DecisionTree * tree : trees) delete tree;
+  }
   
   // Save histograms in HistService (if any)
   if (HistService::Instance().GetMap().size() > 0) {
@@ -163,6 +191,9 @@ int main(int argc, char * argv[]) {
     histOut->Write();
   }
   
+  // wait for worker processes
+  Communicator::Instance().Finish();
+
   // time spent on growing tree
   double duration = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
   
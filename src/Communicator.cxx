@@ -0,0 +1,207 @@
+// local includes
+#include "Communicator.h"
+#include "Config.h"
+
+// stl includes
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cerrno>
+
+// system includes
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+
+Communicator::Communicator() :
+  m_rank(0),
+  m_size(1),
+  m_mode(DATA_PARALLEL),
+  m_sockets(),
+  m_workers(),
+  m_buffer(),
+  m_log("Communicator")
+{
+
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+}
+
+
+void Communicator::Start(int nProcesses, MODE mode)
+{
+
+  // check state
+  if ( m_size > 1 ) {
+    m_log << Log::ERROR << "Start() : Worker processes are already running" << Log::endl();
+    throw(0);
+  }
+  m_mode = mode;
+  if ( nProcesses <= 1 ) return;
+
+  // fork workers (each connected to the first process by a socket pair)
+  m_log << Log::INFO << "Start() : Starting " << nProcesses - 1 << " worker processes (" << (mode == FEATURE_PARALLEL ? "feature" : "data") << "-parallel)" << Log::endl();
+  for (int rank = 1; rank < nProcesses; ++rank) {
+    int fds[2];
+    if ( socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0 ) {
+      m_log << Log::ERROR << "Start() : Couldn't create socket pair (" << std::strerror(errno) << ")" << Log::endl();
+      throw(0);
+    }
+    pid_t pid = fork();
+    if ( pid < 0 ) {
+      m_log << Log::ERROR << "Start() : Couldn't fork worker process (" << std::strerror(errno) << ")" << Log::endl();
+      throw(0);
+    }
+    if ( pid == 0 ) {
+
+      // worker: keep only the socket to the first process
+      for (int fd : m_sockets) close(fd);
+      close(fds[0]);
+      m_sockets.assign(1, fds[1]);
+      m_workers.clear();
+      m_rank = rank;
+      m_size = nProcesses;
+
+      // workers only print warnings and errors, prefixed with their rank
+      Log::SetProcess("[" + std::to_string(rank) + "] ", Log::WARNING);
+      return;
+
+    }
+    close(fds[1]);
+    m_sockets.push_back(fds[0]);
+    m_workers.push_back(pid);
+  }
+  m_size = nProcesses;
+
+}
+
+
+void Communicator::Finish()
+{
+
+  // close sockets (workers waiting for a message see the end of the stream)
+  for (int fd : m_sockets) close(fd);
+  m_sockets.clear();
+
+  // wait for workers
+  for (int pid : m_workers) {
+    int status = 0;
+    if ( waitpid(pid, &status, 0) < 0 || ! WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+      m_log << Log::WARNING << "Finish() : Worker process " << pid << " didn't finish successfully" << Log::endl();
+    }
+  }
+  m_workers.clear();
+
+}
+
+
+void Communicator::Shard(long nEntries, long & first, long & last) const
+{
+
+  first = nEntries*ShardIndex()/NumberOfShards();
+  last  = nEntries*(ShardIndex() + 1)/NumberOfShards();
+
+}
+
+
+void Communicator::AllReduce(double * data, unsigned long n, OPERATION operation)
+{
+
+  if ( m_size <= 1 ) return;
+
+  // worker: send values, and receive the combined values
+  if ( m_rank > 0 ) {
+    Send(m_sockets[0], data, n);
+    Receive(m_sockets[0], data, n);
+    return;
+  }
+
+  // first process: combine values of all workers in order of rank, and send the result back
+  m_buffer.resize(n);
+  for (int fd : m_sockets) {
+    Receive(fd, m_buffer.data(), n);
+    for (unsigned long i = 0; i < n; ++i) {
+      if      ( operation == SUM ) data[i] += m_buffer[i];
+      else if ( operation == MIN ) data[i] = std::min(data[i], m_buffer[i]);
+      else if ( operation == MAX ) data[i] = std::max(data[i], m_buffer[i]);
+    }
+  }
+  for (int fd : m_sockets) Send(fd, data, n);
+
+}
+
+
+double Communicator::AllReduce(double value, OPERATION operation)
+{
+
+  AllReduce(&value, 1, operation);
+
+  return value;
+
+}
+
+
+void Communicator::AllReduceShards(double * data, unsigned long n, OPERATION operation)
+{
+
+  if ( NumberOfShards() > 1 ) AllReduce(data, n, operation);
+
+}
+
+
+void Communicator::Send(int fd, const double * data, unsigned long n) const
+{
+
+  // message is the number of values followed by the values
+  unsigned long header = n;
+  const char * parts[2] = {reinterpret_cast<const char *>(&header), reinterpret_cast<const char *>(data)};
+  unsigned long sizes[2] = {sizeof(header), n*sizeof(double)};
+  for (int ipart = 0; ipart < 2; ++ipart) {
+    unsigned long sent = 0;
+    while ( sent < sizes[ipart] ) {
+      ssize_t result = send(fd, parts[ipart] + sent, sizes[ipart] - sent, MSG_NOSIGNAL);
+      if ( result < 0 && errno == EINTR ) continue;
+      if ( result <= 0 ) {
+        m_log << Log::ERROR << "Send() : Connection to other process lost (" << std::strerror(errno) << ")" << Log::endl();
+        throw(0);
+      }
+      sent += result;
+    }
+  }
+
+}
+
+
+void Communicator::Receive(int fd, double * data, unsigned long n) const
+{
+
+  // message is the number of values followed by the values (a different number means the processes are out of step)
+  unsigned long header = 0;
+  char * parts[2] = {reinterpret_cast<char *>(&header), reinterpret_cast<char *>(data)};
+  unsigned long sizes[2] = {sizeof(header), n*sizeof(double)};
+  for (int ipart = 0; ipart < 2; ++ipart) {
+    unsigned long received = 0;
+    while ( received < sizes[ipart] ) {
+      ssize_t result = read(fd, parts[ipart] + received, sizes[ipart] - received);
+      if ( result < 0 && errno == EINTR ) continue;
+      if ( result <= 0 ) {
+        m_log << Log::ERROR << "Receive() : Connection to other process lost" << Log::endl();
+        throw(0);
+      }
+      received += result;
+    }
+    if ( ipart == 0 && header != n ) {
+      m_log << Log::ERROR << "Receive() : Expected " << n << " values, but the other process sent " << header << " (processes are out of step)" << Log::endl();
+      throw(0);
+    }
+  }
+
+}
@@ -0,0 +1,98 @@
+//local includes
+#include "Forest.h"
+#include "Variables.h"
+#include "Config.h"
+#include "Log.h"
+
+// stl includes
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+// system includes
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+
+int main(int argc, char * argv[]) {
+
+  // check number of arguments
+  if ( argc != 2 ) {
+    std::cout << "Provide 1 argument: ./bin/CompileForest <config-path>" << std::endl;
+    return 0;
+  }
+
+  // get confiuration file
+  std::string configpath = argv[1];
+  Config::Instance(configpath.c_str());
+
+  // initialize log
+  Log log("CompileForest");
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    log.SetLevel(level);
+  }
+
+  // initialize variables (needs to be done before reading the weights)
+  Variables::Initialize();
+
+  // read weights file (text or binary)
+  std::string weightsFileName = Config::Instance().get<std::string>("WeightsFileName");
+  const std::vector<const Forest *> forests = Forest::ReadForests(weightsFileName);
+
+  // write source file
+  std::string libraryName = weightsFileName + ".so";
+  Config::Instance().getif<std::string>("CompiledForestLibrary", libraryName);
+  std::string sourceName = libraryName + ".cxx";
+  Config::Instance().getif<std::string>("CompiledForestSource", sourceName);
+  Forest::WriteSource(forests, sourceName);
+
+  // compile shared library (use 'CompiledForestLibrary = <library>' in the ApplyWeights configuration to use it); the
+  // compiler is run without a shell, the compiler setting is split at whitespace and the file names are passed as they are
+  std::string compiler = "g++ -std=c++11 -O2 -shared -fPIC";
+  Config::Instance().getif<std::string>("CompiledForestCompiler", compiler);
+  std::vector<std::string> args;
+  std::istringstream compilerStream(compiler);
+  for (std::string arg; compilerStream >> arg; ) args.push_back(arg);
+  if ( args.empty() ) {
+    log << Log::ERROR << "No compiler given ('CompiledForestCompiler')" << Log::endl();
+    return 1;
+  }
+  args.push_back(sourceName);
+  args.push_back("-o");
+  args.push_back(libraryName);
+  std::vector<char *> compilerArgv;
+  log << Log::INFO << "Compiling :";
+  for (std::string & arg : args) {
+    log << " '" << arg << "'";
+    compilerArgv.push_back(&arg[0]);
+  }
+  log << Log::endl();
+  compilerArgv.push_back(0);
+  pid_t pid = fork();
+  if ( pid < 0 ) {
+    log << Log::ERROR << "Couldn't start compiler (" << std::strerror(errno) << ")" << Log::endl();
+    return 1;
+  }
+  if ( pid == 0 ) {
+    execvp(compilerArgv[0], compilerArgv.data());
+    _exit(127);
+  }
+  int status = 0;
+  while ( waitpid(pid, &status, 0) < 0 && errno == EINTR );
+  if ( ! WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+    log << Log::ERROR << "Compilation of " << sourceName << " failed" << (WIFEXITED(status) && WEXITSTATUS(status) == 127 ? " (couldn't run " + args[0] + ")" : "") << Log::endl();
+    return 1;
+  }
+
+  // and we're done!
+  log << Log::INFO << "Compiled " << weightsFileName << " to " << libraryName << Log::endl();
+  return 0;
+
+}
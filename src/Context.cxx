@@ -0,0 +1,86 @@
+// local includes
+#include "Context.h"
+#include "Config.h"
+
+// ROOT includes
+#include "TH1F.h"
+
+
+Context::Context(const EventCache * source, const EventCache * target, const HistDefs * histDefs, unsigned int seed) :
+  m_source(source),
+  m_target(target),
+  m_histDefs(histDefs),
+  m_indicesSource(),
+  m_indicesTarget(),
+  m_multiplicitySource(),
+  m_multiplicityTarget(),
+  m_seed(seed),
+  m_treeIndex(0),
+  m_hists(),
+  m_histMap(),
+  m_log("Context")
+{
+
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+}
+
+
+Context::~Context()
+{
+
+  for (TH1F * hist : m_hists) delete hist;
+
+}
+
+
+TH1F * Context::AddHist(const std::string & name, int nbins, float xmin, float xmax)
+{
+
+  // check if already exists
+  if ( m_histMap.find(name) != m_histMap.end() ) {
+    m_log << Log::ERROR << "AddHist() : Histogram with name = " << name << " already exists!" << Log::endl();
+    throw(0);
+  }
+
+  // add histogram
+  TH1F * hist = new TH1F(name.c_str(), name.c_str(), nbins, xmin, xmax);
+  hist->SetDirectory(0);
+  m_hists.push_back(hist);
+  m_histMap[name] = hist;
+
+  return hist;
+
+}
+
+
+TH1F * Context::GetHist(const std::string & name) const
+{
+
+  std::map<std::string, TH1F *>::const_iterator itr = m_histMap.find(name);
+  if ( itr == m_histMap.end() ) {
+    m_log << Log::ERROR << "GetHist() : Couldn't find histogram with name = " << name << Log::endl();
+    throw(0);
+  }
+
+  return itr->second;
+
+}
+
+
+std::vector<TH1F *> Context::TakeHists()
+{
+
+  std::vector<TH1F *> hists;
+  hists.swap(m_hists);
+  m_histMap.clear();
+
+  return hists;
+
+}
@@ -0,0 +1,50 @@
+//local includes
+#include "Forest.h"
+#include "Variables.h"
+#include "Config.h"
+#include "Log.h"
+
+// stl includes
+#include <vector>
+#include <string>
+
+
+
+int main(int argc, char * argv[]) {
+
+  // check number of arguments
+  if ( argc != 2 ) {
+    std::cout << "Provide 1 argument: ./bin/ConvertWeights <config-path>" << std::endl;
+    return 0;
+  }
+
+  // get confiuration file
+  std::string configpath = argv[1];
+  Config::Instance(configpath.c_str());
+
+  // initialize log
+  Log log("ConvertWeights");
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    log.SetLevel(level);
+  }
+
+  // initialize variables (needs to be done before reading the weights)
+  Variables::Initialize();
+
+  // read text weights file
+  std::string weightsFileName = Config::Instance().get<std::string>("WeightsFileName");
+  const std::vector<const Forest *> forests = Forest::ReadForests(weightsFileName);
+
+  // write binary weights file (can be used as 'WeightsFileName' in ApplyWeights)
+  std::string binaryFileName = weightsFileName + ".bin";
+  Config::Instance().getif<std::string>("BinaryWeightsFileName", binaryFileName);
+  Forest::WriteBinary(forests, binaryFileName);
+
+  // and we're done!
+  log << Log::INFO << "Converted " << weightsFileName << " to " << binaryFileName << Log::endl();
+  return 0;
+
+}
@@ -103,6 +103,7 @@ int main(int argc, char * argv[]) {
   Event & event = Event::Instance();
   event.ConnectAllVariables(source, false);
   event.ConnectAllVariables(target_true, false, false);
+  FieldHandle<float> evtWeight = event.handle<float>(eventWeightName);
 
   // prepare for loop over tree entries
   long maxEvent = source->GetEntries();
@@ -125,10 +126,10 @@ int main(int argc, char * argv[]) {
     source->GetEntry( ievent );
 
     // get event weight
-    static float & evtWeight = Event::Instance().get<float>(eventWeightName);
-    weight = evtWeight;
+    weight = *evtWeight;
     
     // multiply with efficiency weight
+    Variables::Read();
     for (const Variable * var : Variables::Get()) {
       effFunc.SetVariable((var->Name()).c_str(), var->Value());
     }
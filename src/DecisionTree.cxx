@@ -3,26 +3,47 @@
 #include "Branch.h"
 #include "Node.h"
 #include "Config.h"
-#include "Event.h"
+#include "EventCache.h"
 #include "HistDefs.h"
+#include "Variables.h"
+#include "Context.h"
+#include "Communicator.h"
+#include "Variable.h"
 
 // stl includes
 #include <vector>
 #include <algorithm>
 #include <limits>
-
-// ROOT includes
-#include "TTree.h"
-#include "TRandom3.h"
-
-
-
-DecisionTree::DecisionTree(TTree * source, TTree * target, const std::vector<long> * indicesSource, const std::vector<long> * indicesTarget, const HistDefs * histDefs) :
-  m_source(source),
-  m_target(target),
-  m_indicesSource(indicesSource),
-  m_indicesTarget(indicesTarget),
-  m_histDefs(histDefs),
+#include <cmath>
+#include <thread>
+#include <string>
+#include <utility>
+
+
+
+DecisionTree::DecisionTree(Context & context) :
+  m_source(context.Source()),
+  m_target(context.Target()),
+  m_indicesSource(&context.IndicesSource()),
+  m_indicesTarget(&context.IndicesTarget()),
+  m_multiplicitySource(&context.MultiplicitySource()),
+  m_multiplicityTarget(&context.MultiplicityTarget()),
+  m_context(&context),
+  m_bagging(false),
+  m_maxLayers(0),
+  m_learningRate(1),
+  m_nThreads(1),
+  m_nodeSettings(),
+  m_nodePool(),
+  m_branchPool(),
+  m_nodes(),
+  m_flatNodes(),
+  m_flatWeights(),
+  m_nodeArray(0),
+  m_nNodeArray(0),
+  m_weightArray(0),
+  m_nWeightArray(0),
+  m_function(0),
   m_log("DecisionTree")
 {
 
@@ -33,16 +54,43 @@ DecisionTree::DecisionTree(TTree * source, TTree * target, const std::vector<lon
     Log::LEVEL level = Log::StringToLEVEL(str_level);
     m_log.SetLevel(level);
   }
+
+  // get number of threads
+  Config::Instance().getif<int>("NumberOfThreads", m_nThreads);
+
+  // if doing bagging, don't use event weight when filling nodes since it has already been used to obtain an unweighted sub-sample (in src/Algorithm.cxx)
+  Config::Instance().getif<bool>("Bagging", m_bagging); 
+
+  // get maximum number of layers and learning rate
+  m_maxLayers    = Config::Instance().get<int>("MaxTreeLayers");
+  m_learningRate = Config::Instance().get<float>("LearningRate");
   
 }
 
 
-DecisionTree::DecisionTree(const std::vector<std::pair<float, std::vector<const Branch::Cut *> > > & tree) :
+DecisionTree::DecisionTree(const std::vector<std::pair<float, std::vector<Branch::Cut> > > & tree) :
   m_source(0),
   m_target(0),
   m_indicesSource(0),
   m_indicesTarget(0),
-  m_histDefs(0),
+  m_multiplicitySource(0),
+  m_multiplicityTarget(0),
+  m_context(0),
+  m_bagging(false),
+  m_maxLayers(0),
+  m_learningRate(1),
+  m_nThreads(1),
+  m_nodeSettings(),
+  m_nodePool(),
+  m_branchPool(),
+  m_nodes(),
+  m_flatNodes(),
+  m_flatWeights(),
+  m_nodeArray(0),
+  m_nNodeArray(0),
+  m_weightArray(0),
+  m_nWeightArray(0),
+  m_function(0),
   m_log("DecisionTree")
 {
 
@@ -55,7 +103,7 @@ DecisionTree::DecisionTree(const std::vector<std::pair<float, std::vector<const
   }
   
   // declare first node
-  Node * firstNode = new Node(0); 
+  Node * firstNode = NewNode(0); 
   firstNode->SetStatus(Node::FIRST);   
   AddNodeToTree(firstNode);
   
@@ -66,21 +114,22 @@ DecisionTree::DecisionTree(const std::vector<std::pair<float, std::vector<const
     float weight = tree.at(inode).first;
 
     // get cuts leading to the final node
-    const std::vector<const Branch::Cut *> & cuts = tree.at(inode).second;
+    const std::vector<Branch::Cut> & cuts = tree.at(inode).second;
 
     // now add nodes and branches as needed to reconstruct this part of the decision tree
     Node * node = firstNode;
-    for (const Branch::Cut * cut : cuts) {
+    for (const Branch::Cut & cut : cuts) {
 
       // try to fetch output branch corresponding to the current cut
-      bool isGreater = dynamic_cast<const Branch::Greater *>(cut);
+      bool isGreater = cut.IsGreater();
       Branch * branch = const_cast<Branch *>(node->OutputBranch(isGreater));
       
       // if branch doesn't exist, then create it (and its output node), otherwise fetch its output node
       if ( ! branch ) {
-	Branch * b = new Branch(node, cut->GetVariable()->Name(), cut->CutValue(), isGreater, 0, 0);
+	m_branchPool.emplace_back(node, cut.GetVariable(), cut.CutValue(), isGreater, 0, 0);
+	Branch * b = &m_branchPool.back();
 	node->SetOutputBranch(b, isGreater);
-	node = new Node(b);
+	node = NewNode(b);
 	node->SetStatus(Node::INTERMEDIATE);
 	AddNodeToTree(node);
       }
@@ -96,6 +145,9 @@ DecisionTree::DecisionTree(const std::vector<std::pair<float, std::vector<const
     
   }
 
+  // convert to flat arrays
+  Compile();
+
   // print tree to screen
   m_log << Log::VERBOSE << "DecisionTree() : ----------------> VERBOSE <----------------" << Log::endl();
   Print("DecisionTree() : ", Log::VERBOSE);
@@ -104,41 +156,123 @@ DecisionTree::DecisionTree(const std::vector<std::pair<float, std::vector<const
 }
 
 
-DecisionTree::~DecisionTree()
+DecisionTree::DecisionTree(const FlatNode * nodes, unsigned int nNodes, const float * weights, unsigned int nWeights) :
+  m_source(0),
+  m_target(0),
+  m_indicesSource(0),
+  m_indicesTarget(0),
+  m_multiplicitySource(0),
+  m_multiplicityTarget(0),
+  m_context(0),
+  m_bagging(false),
+  m_maxLayers(0),
+  m_learningRate(1),
+  m_nThreads(1),
+  m_nodeSettings(),
+  m_nodePool(),
+  m_branchPool(),
+  m_nodes(),
+  m_flatNodes(),
+  m_flatWeights(),
+  m_nodeArray(nodes),
+  m_nNodeArray(nNodes),
+  m_weightArray(weights),
+  m_nWeightArray(nWeights),
+  m_function(0),
+  m_log("DecisionTree")
 {
 
-  for (unsigned int i = 0; i < m_nodes.size(); ++i) {
-    delete m_nodes.at(i);
-    m_nodes.at(i) = 0;
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+  // check that every path ends at a final node (output nodes always come after their input node in depth-first order)
+  if ( nWeights != nNodes + 1 ) {
+    m_log << Log::ERROR << "DecisionTree() : Inconsistent number of nodes (" << nNodes << ") and final nodes (" << nWeights << ")" << Log::endl();
+    throw(0);
   }
+  unsigned int nVariables = Variables::Get().size();
+  for (unsigned int inode = 0; inode < nNodes; ++inode) {
+    const FlatNode & node = nodes[inode];
+    bool valid = node.variable < nVariables;
+    for (int output : node.output) {
+      if ( output >= 0 ) valid = valid && static_cast<unsigned int>(output) > inode && static_cast<unsigned int>(output) < nNodes;
+      else               valid = valid && static_cast<unsigned int>(~output) < nWeights;
+    }
+    if ( ! valid ) {
+      m_log << Log::ERROR << "DecisionTree() : Invalid node at position " << inode << Log::endl();
+      throw(0);
+    }
+  }
+
+}
+
+
+DecisionTree::~DecisionTree()
+{
+
+  // nodes and branches are deleted with their storage
   
 }
 
 
-void DecisionTree::GrowTree(std::vector<float> * MLWeights)
+void DecisionTree::SetNumberOfThreads(int nThreads)
+{
+
+  m_nThreads = nThreads;
+
+}
+
+
+void DecisionTree::SetFunction(Function function) const
 {
 
-  // print info
-  static int counter = 1;
-  m_log << Log::INFO << "GrowTree() : Decision Tree " << counter++ << Log::endl();
+  m_function = function;
+
+}
+
+
+void DecisionTree::GrowTree(ScratchBuffer * MLWeights)
+{
+
+  // print info (trees may be grown in parallel)
+  m_log << Log::INFO << "GrowTree() : Decision Tree " << m_context->TreeIndex() + 1 << Log::endl();
 
   // keep track of time
   std::clock_t start = std::clock();
 
   // declare first node
-  Node * node = new Node(0);
+  Node * node = NewNode(0);
 
   // declare vector to hold nodes in a given layer
   std::vector<Node *> layer;
   layer.push_back(node);
+
+  // declare event -> node assignments (position of the event's node in the current layer, -1 if the node is not grown further;
+  // the buffers start out zero, i.e. all events are in the first node)
+  ScratchBuffer nodeIndicesSource;
+  ScratchBuffer nodeIndicesTarget;
+  nodeIndicesSource.Allocate(m_source->Entries()*sizeof(int), ScratchBuffer::Directory());
+  nodeIndicesTarget.Allocate(m_target->Entries()*sizeof(int), ScratchBuffer::Directory());
+
+  // declare positions of sibling nodes in the current layer (-1 if the sibling is not grown further), and the nodes of the previous layer
+  // (their histograms are kept until the current layer is filled)
+  std::vector<int> siblings(layer.size(), -1);
+  std::vector<Node *> previousLayer;
+
+  // declare histogram buffers (allocated once per thread, and reused for all layers and trees)
+  static thread_local std::vector<double> histBuffers[2];
   
   // grow tree layer-by-layer
   int nlayers = 0;
   while ( layer.size() > 0 ) {
 
     // check number of layers
-    static int maxLayers = Config::Instance().get<int>("MaxTreeLayers");
-    if ( nlayers >= maxLayers ) {
+    if ( nlayers >= m_maxLayers ) {
 
       // print verbose message
       m_log << Log::VERBOSE << "GrowTree() : Max layers reached - finalizing nodes!" << Log::endl();
@@ -156,37 +290,108 @@ void DecisionTree::GrowTree(std::vector<float> * MLWeights)
 
     // initialise histograms for each variable on nodes
     for (Node * node : layer) {
-      node->Initialize(m_histDefs);
+      node->Initialize(*m_context);
+    }
+
+    // put the histograms of this layer in one buffer (alternating between two buffers, since the histograms of the previous layer are still needed)
+    std::vector<double> & histBuffer = histBuffers[nlayers % 2];
+    unsigned long histBufferSize = 0;
+    for (const Node * node : layer) histBufferSize += node->HistBufferSize();
+    histBuffer.assign(histBufferSize, 0.);
+    histBufferSize = 0;
+    for (Node * node : layer) {
+      node->SetHistBuffer(histBuffer.data() + histBufferSize);
+      histBufferSize += node->HistBufferSize();
     }
       
+    // only fill the smaller of two sibling nodes, and get the larger one by subtracting the smaller one from their parent
+    // (this needs histograms for all variables of the larger node on both the parent and the sibling)
+    std::vector<Node *> fillLayer(layer);
+    std::vector<unsigned int> subtractNodes;
+    for (unsigned int inode = 0; inode < layer.size(); ++inode) {
+      int isibling = siblings[inode];
+      if ( isibling < 0 ) continue;
+      const Node * node    = layer[inode];
+      const Node * sibling = layer[isibling];
+      float sum        = node   ->SumSource() + node   ->SumTarget();
+      float sumSibling = sibling->SumSource() + sibling->SumTarget();
+      if ( sum < sumSibling || (sum == sumSibling && static_cast<int>(inode) < isibling) ) continue;
+      const Node * parent = node->InputBranch()->InputNode();
+      if ( parent->HasHists(node) && sibling->HasHists(node) ) {
+	fillLayer[inode] = 0;
+	subtractNodes.push_back(inode);
+      }
+    }
+    
     // fill nodes (first target, then source)
     // (if MLWeights from previous trees are provided (BDT), they are used in conjunction with the intrinsic event weight)
-    FillNodes(layer, TARGET, 0);
-    FillNodes(layer, SOURCE, MLWeights); 
+    FillNodes(fillLayer, nodeIndicesTarget, TARGET, 0);
+    FillNodes(fillLayer, nodeIndicesSource, SOURCE, MLWeights); 
+
+    // add up the histograms of all event shards (each process fills them with its shard of the events, all get the same
+    // sums and thus build the same nodes)
+    Communicator::Instance().AllReduceShards(histBuffer.data(), histBuffer.size());
+    for (unsigned int inode : subtractNodes) {
+      layer[inode]->Subtract(layer[inode]->InputBranch()->InputNode(), layer[siblings[inode]]);
+    }
+
+    // histograms of the previous layer are no longer needed
+    for (Node * node : previousLayer) node->ClearHists();
     
     // prepare vector for next layer of nodes
     std::vector<Node *> nextLayer;
+
+    // prepare positions of each node's output nodes in the next layer (-1 if not grown further)
+    std::vector<int> nextLow(layer.size(), -1);
+    std::vector<int> nextHigh(layer.size(), -1);
+        
+    // get splits of the nodes (in feature-parallel mode, each process only has the histograms of its variables, so the
+    // processes exchange their best split of each node)
+    std::vector<Node::Summary *> splits(layer.size(), 0);
+    for (unsigned int inode = 0; inode < layer.size(); ++inode) splits[inode] = layer[inode]->Split(*m_context);
+    if ( Communicator::Instance().FeatureParallel() ) ExchangeSplits(splits);
         
     // build nodes
-    for (Node * node : layer) {
+    for (unsigned int inode = 0; inode < layer.size(); ++inode) {
+
+      // get node
+      Node * node = layer[inode];
       
       // declare the node's output branches
       Branch * b1 = 0;
       Branch * b2 = 0;
       
       // build node
-      node->Build(b1, b2);
+      node->Build(b1, b2, m_branchPool, splits[inode]);
 
       // add to decision tree nodes
       AddNodeToTree(node);
       
       // create sub-nodes (if branches exist)
-      if ( b1 ) CreateNode(b1, nextLayer);
-      if ( b2 ) CreateNode(b2, nextLayer);
+      if ( b1 && CreateNode(b1, nextLayer) ) nextLow [inode] = nextLayer.size() - 1;
+      if ( b2 && CreateNode(b2, nextLayer) ) nextHigh[inode] = nextLayer.size() - 1;
+
+      // keep histograms only if both sub-nodes are grown further (then one of them can be obtained by subtraction)
+      if ( nextLow[inode] < 0 || nextHigh[inode] < 0 ) node->ClearHists();
       
     }
 
+    // set sibling positions for next layer
+    siblings.assign(nextLayer.size(), -1);
+    for (unsigned int inode = 0; inode < layer.size(); ++inode) {
+      if ( nextLow[inode] < 0 || nextHigh[inode] < 0 ) continue;
+      siblings[nextLow [inode]] = nextHigh[inode];
+      siblings[nextHigh[inode]] = nextLow [inode];
+    }
+
+    // move events to the output nodes of the split just made
+    if ( nextLayer.size() > 0 ) {
+      UpdateNodeIndices(layer, nextLow, nextHigh, nodeIndicesTarget, TARGET);
+      UpdateNodeIndices(layer, nextLow, nextHigh, nodeIndicesSource, SOURCE);
+    }
+
     // set next layer
+    previousLayer = layer;
     layer = nextLayer;
     
     // increment layer counter
@@ -194,8 +399,14 @@ void DecisionTree::GrowTree(std::vector<float> * MLWeights)
     
   }
 
+  // delete remaining histograms
+  for (Node * node : previousLayer) node->ClearHists();
+
   // calculate and set weights on final nodes
   FinalizeWeights();
+
+  // convert to flat arrays
+  Compile();
   
   // update ML weights
   if ( MLWeights ) UpdateWeights(MLWeights);
@@ -233,8 +444,7 @@ void DecisionTree::FinalizeWeights()
       m_log << Log::ERROR << "FinalizeWeights() : source is not positive! (source = " << source << ")" << Log::endl();
       throw(0);
     }
-    static float learningRate = Config::Instance().get<float>("LearningRate");
-    double w = learningRate > 0.999 ? target/source : exp(learningRate*log(target/source));
+    double w = m_learningRate > 0.999 ? target/source : exp(m_learningRate*log(target/source));
     weights.at(i)  = w;
     sumSource     += w*source;
     sumTarget     += target;
@@ -251,6 +461,12 @@ void DecisionTree::FinalizeWeights()
 void DecisionTree::Print(const std::string & prefix, Log::LEVEL level) const
 {
 
+  // trees read from flat arrays (binary weights file) have no nodes
+  if ( m_nodes.empty() ) {
+    PrintFlat(prefix, level);
+    return;
+  }
+
   // get final nodes
   std::vector<const Node *> finalNodes = FinalNodes();
 
@@ -271,18 +487,9 @@ void DecisionTree::Print(const std::string & prefix, Log::LEVEL level) const
     m_log << "  Cuts = ";
     const Branch * b = node->InputBranch();
     while ( b ) {     
-      // get cut object
-      const Branch::Cut * cut = b->CutObject();
-      const Branch::Smaller * lt = dynamic_cast<const Branch::Smaller *>(cut);
-      const Branch::Greater * gt = dynamic_cast<const Branch::Greater *>(cut);    
-      // check if valid
-      if ( (lt && gt) || (!lt && !gt) ) {
-	m_log << Log::endl();
-	m_log << Log::ERROR << prefix << "Couldn't determine if cut is greater or smaller!" << Log::endl();
-	throw(0);
-      }
       // print cut
-      m_log << cut->GetVariable()->Name() << (lt ? "<" : ">") << cut->CutValue() << "|";
+      const Branch::Cut & cut = b->CutObject();
+      m_log << cut.GetVariable()->Name() << (cut.IsGreater() ? ">" : "<") << cut.CutValue() << "|";
       // update branch
       b = b->InputNode()->InputBranch();
     }
@@ -297,52 +504,115 @@ void DecisionTree::Print(const std::string & prefix, Log::LEVEL level) const
 }
 
 
-void DecisionTree::CreateNode(Branch * input, std::vector<Node *> & nextLayer) 
+void DecisionTree::PrintFlat(const std::string & prefix, Log::LEVEL level) const
+{
+
+  // walk the flat nodes depth-first (keeping the cuts leading to each node), and print the weight and cuts of each final
+  // node (cuts from the final node up to the first node, as for trees with nodes)
+  // (each cut is the position of the node and whether the path goes above the cut)
+  typedef std::vector<std::pair<int, bool> > Cuts;
+  std::vector<std::pair<int, Cuts> > stack(1, std::make_pair(m_nNodeArray > 0 ? 0 : ~0, Cuts()));
+  while ( ! stack.empty() ) {
+    int inode = stack.back().first;
+    Cuts cuts = stack.back().second;
+    stack.pop_back();
+    if ( inode < 0 ) {
+      m_log << level << prefix << " ---> Weight = " << std::setw(10) << std::left << m_weightArray[~inode] << "  Cuts = ";
+      for (Cuts::const_reverse_iterator cut = cuts.rbegin(); cut != cuts.rend(); ++cut) {
+	const FlatNode & node = m_nodeArray[cut->first];
+	m_log << Variables::Get().at(node.variable)->Name() << (cut->second ? ">" : "<") << node.cutValue << "|";
+      }
+      m_log << Log::endl();
+      continue;
+    }
+    const FlatNode & node = m_nodeArray[inode];
+    cuts.push_back(std::make_pair(inode, true));
+    stack.push_back(std::make_pair(node.output[1], cuts));
+    cuts.back().second = false;
+    stack.push_back(std::make_pair(node.output[0], cuts));
+  }
+
+  // print more info
+  m_log << level << prefix << "Final nodes  : " << m_nWeightArray << " (out of " << m_nNodeArray + m_nWeightArray << ")" << Log::endl();
+
+}
+
+
+bool DecisionTree::CreateNode(Branch * input, std::vector<Node *> & nextLayer) 
 {
 
   // declare node
-  Node * node = new Node(input);
+  Node * node = NewNode(input);
 
   // check if it's a FINAL node or if we can grow it further
   if (node->Status() == Node::FINAL) {
     AddNodeToTree( node );
+    return false;
+  }
+
+  nextLayer.push_back( node );
+  return true;
+
+}
+
+
+void DecisionTree::GetSample(INPUT input, const EventCache *& cache, const std::vector<long> *& indices, const std::vector<unsigned char> *& multiplicities) const
+{
+
+  if ( input == SOURCE ) {
+    cache          = m_source;
+    indices        = m_indicesSource;
+    multiplicities = m_multiplicitySource;
   }
   else {
-    nextLayer.push_back( node );
+    cache          = m_target;
+    indices        = m_indicesTarget;
+    multiplicities = m_multiplicityTarget;
   }
 
 }
 
 
-void DecisionTree::FillNodes(std::vector<Node *> layer, INPUT input, std::vector<float> * MLWeights) const
+void DecisionTree::FillNodes(const std::vector<Node *> & layer, const ScratchBuffer & nodeIndices, INPUT input, const ScratchBuffer * MLWeights) const
 {
 
   // switch target/source
-  TTree * tree = 0;
+  const EventCache * cache = 0;
   const std::vector<long> * indices = 0;
-  if ( input == SOURCE ) {
-    tree    = m_source;
-    indices = m_indicesSource;
-  }
-  else if ( input == TARGET ) {
-    tree    = m_target;
-    indices = m_indicesTarget;
+  const std::vector<unsigned char> * multiplicities = 0;
+  GetSample(input, cache, indices, multiplicities);
+  bool poisson = ! multiplicities->empty();
+
+  // use several threads if requested (but make sure each thread has more events than bins to fill, otherwise it doesn't pay off)
+  long maxEvent = poisson ? multiplicities->size() : indices->size();
+  if ( m_nThreads > 1 ) {
+    long bufferSize = 0;
+    for (const Node * node : layer) bufferSize += node ? node->BufferSize() : 0;
+    int nThreads = std::min<long>(m_nThreads, maxEvent/(bufferSize + 1));
+    if ( nThreads > 1 ) {
+      FillNodesThreaded(layer, nodeIndices, input, MLWeights, nThreads);
+      return;
+    }
   }
- 
-  // get intrinsic event weight name
-  std::string eventWeightName = Config::Instance().get<std::string>("EventWeightVariableName");
 
-  // if doing bagging, don't use event weight since it has already been used to obtain an unweighted sub-sample (in src/Algorithm.cxx)
-  static bool bagging = false;
-  Config::Instance().getif<bool>("Bagging", bagging); 
+  // get per-event data
+  const int * nodeIndex = nodeIndices.Data<int>();
+  const float * MLWeight = MLWeights ? MLWeights->Data<float>() : 0;
+  long chunkSize = cache->ChunkSize(sizeof(int) + (MLWeights ? sizeof(float) : 0));
+  long chunkFirst = 0;
 
-  // Loop over TTree entries
+  // Loop over cached events
   std::clock_t start = std::clock();
-  long maxEvent = indices->size();
   long reportFrac = maxEvent/(maxEvent > 100000 ? 10 : 1) + 1;
-  m_log << Log::VERBOSE << "FillNodes() : Looping over events (" << tree->GetName() << ") : "  << maxEvent << Log::endl();
+  m_log << Log::VERBOSE << "FillNodes() : Looping over events (" << cache->Name() << ") : "  << maxEvent << Log::endl();
   for (long ievent = 0; ievent < maxEvent; ++ievent) {
 
+    // release finished chunk
+    if ( ievent - chunkFirst == chunkSize ) {
+      ReleaseEvents(input, chunkFirst, ievent, &nodeIndices, MLWeights);
+      chunkFirst = ievent;
+    }
+
     // print progress
     if( ievent > 0 && ievent % reportFrac == 0 ) {
       double duration     = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
@@ -351,48 +621,34 @@ void DecisionTree::FillNodes(std::vector<Node *> layer, INPUT input, std::vector
       m_log << Log::VERBOSE << "FillNodes() : ---> processed : " << std::setw(4) << 100*ievent/maxEvent << "\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time : " << std::setw(4) << static_cast<int>(timeEstimate) << " sec"<< Log::endl(); 
     }
 
-    // event index
-    long index = indices->at(ievent);
+    // event index and multiplicity
+    long index = poisson ? ievent : indices->at(ievent);
+    unsigned int multiplicity = poisson ? (*multiplicities)[ievent] : 1;
+    if ( multiplicity == 0 ) continue;
     
-    // get event
-    tree->GetEntry( index );
-
-    // loop over nodes
-    for (Node * node : layer) {
-    
-      // apply cuts
-      bool pass = true;
-      const Branch * b = node->InputBranch();
-      while ( b ) {
-	if ( ! b->Pass() ) {
-	  pass = false;
-	  break;
-	}
-	b = b->InputNode()->InputBranch();
-      }
-      if ( ! pass ) continue;
-      
-      // get intrinsic event weight
-      static const float & eventWeight = Event::Instance().get<float>(eventWeightName);
+    // get intrinsic event weight
+    float eventWeight = cache->Weight( index );
+
+    // get the event's node (skip event if its node is not being grown or not filled)
+    int inode = nodeIndex[index];
+    if ( inode < 0 ) continue;
+    Node * node = layer[inode];
+    if ( ! node ) continue;
       
-      // fill nodes
-      float MLw = 1.;
-      if ( MLWeights ) {
-	MLw = MLWeights->at(index);
-      }
-      if ( input == SOURCE ) {
-	node->FillSource( MLw*(bagging ? 1 : eventWeight) );	  
-      }
-      else if ( input == TARGET ) {
-	node->FillTarget( bagging ? 1 : eventWeight );
-      }
-       
-      // all nodes are orthogonal, so we can break the loop here
-      break;
-
+    // fill node
+    float MLw = 1.;
+    if ( MLWeight ) {
+      MLw = MLWeight[index];
+    }
+    if ( input == SOURCE ) {
+      node->FillSource( cache, index, MLw*(m_bagging ? multiplicity : eventWeight) );	  
+    }
+    else if ( input == TARGET ) {
+      node->FillTarget( cache, index, m_bagging ? multiplicity : eventWeight );
     }
     
   }
+  ReleaseEvents(input, chunkFirst, maxEvent, &nodeIndices, MLWeights);
 
   // print out
   double duration  = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
@@ -402,20 +658,195 @@ void DecisionTree::FillNodes(std::vector<Node *> layer, INPUT input, std::vector
 }
 
 
-void DecisionTree::UpdateWeights(std::vector<float> * MLWeights) const
+void DecisionTree::FillNodesThreaded(const std::vector<Node *> & layer, const ScratchBuffer & nodeIndices, INPUT input, const ScratchBuffer * MLWeights, int nThreads) const
+{
+
+  // switch target/source
+  const EventCache * cache = 0;
+  const std::vector<long> * indices = 0;
+  const std::vector<unsigned char> * multiplicities = 0;
+  GetSample(input, cache, indices, multiplicities);
+  bool poisson = ! multiplicities->empty();
+
+  // get offset of each node in the histogram buffers
+  std::vector<unsigned int> offsets(layer.size() + 1, 0);
+  for (unsigned int inode = 0; inode < layer.size(); ++inode) {
+    offsets[inode + 1] = offsets[inode] + (layer[inode] ? layer[inode]->BufferSize() : 0);
+  }
+
+  // declare private histogram buffers (sum of weights and sum of squared weights) for each thread
+  std::vector<std::vector<double> > sumw (nThreads, std::vector<double>(offsets.back(), 0.));
+  std::vector<std::vector<double> > sumw2(nThreads, std::vector<double>(offsets.back(), 0.));
+
+  // get per-event data (each thread releases its chunks)
+  const int * nodeIndex = nodeIndices.Data<int>();
+  const float * MLWeight = MLWeights ? MLWeights->Data<float>() : 0;
+  long chunkSize = std::max(cache->ChunkSize(sizeof(int) + (MLWeights ? sizeof(float) : 0))/nThreads, 1L);
+
+  // fill buffers, each thread taking a contiguous range of events
+  std::clock_t start = std::clock();
+  long maxEvent = poisson ? multiplicities->size() : indices->size();
+  m_log << Log::VERBOSE << "FillNodesThreaded() : Looping over events (" << cache->Name() << ") : "  << maxEvent << " using " << nThreads << " threads" << Log::endl();
+  std::vector<std::thread> threads;
+  for (int ithread = 0; ithread < nThreads; ++ithread) {
+    long first = maxEvent*ithread/nThreads;
+    long last  = maxEvent*(ithread + 1)/nThreads;
+    threads.push_back( std::thread( [&, ithread, first, last]() {
+	  double * threadSumw  = sumw [ithread].data();
+	  double * threadSumw2 = sumw2[ithread].data();
+	  long chunkFirst = first;
+	  for (long ievent = first; ievent < last; ++ievent) {
+	    if ( ievent - chunkFirst == chunkSize ) {
+	      ReleaseEvents(input, chunkFirst, ievent, &nodeIndices, MLWeights);
+	      chunkFirst = ievent;
+	    }
+	    long index = poisson ? ievent : (*indices)[ievent];
+	    unsigned int multiplicity = poisson ? (*multiplicities)[ievent] : 1;
+	    if ( multiplicity == 0 ) continue;
+	    int inode = nodeIndex[index];
+	    if ( inode < 0 || ! layer[inode] ) continue;
+	    float weight = m_bagging ? multiplicity : cache->Weight( index );
+	    if ( MLWeight ) weight *= MLWeight[index];
+	    layer[inode]->FillBuffer(cache, index, weight, threadSumw + offsets[inode], threadSumw2 + offsets[inode]);
+	  }
+	  ReleaseEvents(input, chunkFirst, last, &nodeIndices, MLWeights);
+	} ) );
+  }
+  for (std::thread & thread : threads) thread.join();
+
+  // add buffers to the node histograms (in thread order, so the result doesn't depend on scheduling)
+  for (int ithread = 0; ithread < nThreads; ++ithread) {
+    for (unsigned int inode = 0; inode < layer.size(); ++inode) {
+      if ( ! layer[inode] ) continue;
+      if ( input == SOURCE ) layer[inode]->AddSource(sumw[ithread].data() + offsets[inode], sumw2[ithread].data() + offsets[inode]);
+      else                   layer[inode]->AddTarget(sumw[ithread].data() + offsets[inode], sumw2[ithread].data() + offsets[inode]);
+    }
+  }
+
+  // print out
+  double duration  = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
+  m_log << Log::VERBOSE<< "FillNodesThreaded() : ---> processed :  100\%  ---  cpu time : " << std::setw(4) << static_cast<int>(duration) << " sec" << Log::endl(); 
+  
+}
+
+
+void DecisionTree::ExchangeSplits(std::vector<Node::Summary *> & splits) const
 {
 
-  // get TTree
-  TTree * tree = m_source;
-  const std::vector<long> * indices = m_indicesSource;
+  // one slot per node and process: flag (split found) followed by the summary in flat form
+  Communicator & communicator = Communicator::Instance();
+  const unsigned int slotSize = Node::Summary::NVALUES + 1;
+  const unsigned int nodeSize = communicator.Size()*slotSize;
+  std::vector<double> values(splits.size()*nodeSize, 0.);
+  for (unsigned int inode = 0; inode < splits.size(); ++inode) {
+    if ( ! splits[inode] ) continue;
+    double * slot = values.data() + inode*nodeSize + communicator.Rank()*slotSize;
+    slot[0] = 1;
+    splits[inode]->Pack(slot + 1);
+  }
+  communicator.AllReduce(values.data(), values.size());
+
+  // pick the split with the highest chisquare (the first variable in case of ties, as in the single-process search)
+  for (unsigned int inode = 0; inode < splits.size(); ++inode) {
+    const double * best = 0;
+    for (int rank = 0; rank < communicator.Size(); ++rank) {
+      const double * slot = values.data() + inode*nodeSize + rank*slotSize;
+      if ( slot[0] == 0 ) continue;
+      Node::Summary summary(slot + 1);
+      if ( best ) {
+	Node::Summary bestSummary(best);
+	if ( summary.Chisquare() < bestSummary.Chisquare() ) continue;
+	if ( summary.Chisquare() == bestSummary.Chisquare() && summary.Position() > bestSummary.Position() ) continue;
+      }
+      best = slot + 1;
+    }
+    delete splits[inode];
+    splits[inode] = best ? new Node::Summary(best) : 0;
+  }
+
+}
+
 
-  // Loop over TTree entries
+void DecisionTree::UpdateNodeIndices(const std::vector<Node *> & layer, const std::vector<int> & nextLow, const std::vector<int> & nextHigh, ScratchBuffer & nodeIndices, INPUT input) const
+{
+
+  // switch target/source
+  const EventCache * cache = 0;
+  const std::vector<long> * indices = 0;
+  const std::vector<unsigned char> * multiplicities = 0;
+  GetSample(input, cache, indices, multiplicities);
+  bool poisson = ! multiplicities->empty();
+
+  // get split (variable index and first bin above cut) of each node in the layer
+  std::vector<unsigned int> splitVariable(layer.size(), 0);
+  std::vector<unsigned int> splitBin(layer.size(), 0);
+  for (unsigned int inode = 0; inode < layer.size(); ++inode) {
+    const Branch * b = layer[inode]->OutputBranch(false);
+    if ( ! b ) continue;
+    splitVariable[inode] = b->CutObject().GetVariable()->Index();
+    splitBin[inode]      = b->CutObject().CutBin();
+  }
+
+  // loop over events and move them to the output node of their current node
+  int * nodeIndex = nodeIndices.Data<int>();
+  long chunkSize = cache->ChunkSize(sizeof(int));
+  long chunkFirst = 0;
+  long maxEvent = poisson ? multiplicities->size() : indices->size();
+  for (long ievent = 0; ievent < maxEvent; ++ievent) {
+
+    // release finished chunk
+    if ( ievent - chunkFirst == chunkSize ) {
+      ReleaseEvents(input, chunkFirst, ievent, &nodeIndices, 0);
+      chunkFirst = ievent;
+    }
+
+    // get event index (skipping events which are not in the sub-sample)
+    if ( poisson && (*multiplicities)[ievent] == 0 ) continue;
+    long index = poisson ? ievent : indices->at(ievent);
+
+    // continue if this event was already moved (when using bagging 'with replacement')
+    if ( ! poisson && ievent > 0 && index == indices->at(ievent - 1)) continue;
+
+    // update node index
+    int & inode = nodeIndex[index];
+    if ( inode < 0 ) continue;
+    if ( cache->Bin(splitVariable[inode], index) < splitBin[inode] ) inode = nextLow [inode];
+    else                                                             inode = nextHigh[inode];
+    
+  }
+  ReleaseEvents(input, chunkFirst, maxEvent, &nodeIndices, 0);
+
+}
+
+
+void DecisionTree::UpdateWeights(ScratchBuffer * MLWeights) const
+{
+
+  // get cached source events
+  const EventCache * cache = 0;
+  const std::vector<long> * indices = 0;
+  const std::vector<unsigned char> * multiplicities = 0;
+  GetSample(SOURCE, cache, indices, multiplicities);
+  bool poisson = ! multiplicities->empty();
+
+  // get per-event data
+  float * MLWeight = MLWeights->Data<float>();
+  long chunkSize = cache->ChunkSize(sizeof(float));
+  long chunkFirst = 0;
+
+  // Loop over cached events
   std::clock_t start = std::clock();
-  long maxEvent = indices->size();
+  long maxEvent = poisson ? multiplicities->size() : indices->size();
   long reportFrac = maxEvent/(maxEvent > 100000 ? 10 : 1) + 1;
-  m_log << Log::VERBOSE << "UpdateWeights() : Looping over events (" << tree->GetName() << ") : "  << maxEvent << Log::endl();
+  m_log << Log::VERBOSE << "UpdateWeights() : Looping over events (" << cache->Name() << ") : "  << maxEvent << Log::endl();
   for (long ievent = 0; ievent < maxEvent; ++ievent) {
 
+    // release finished chunk
+    if ( ievent - chunkFirst == chunkSize ) {
+      ReleaseEvents(SOURCE, chunkFirst, ievent, 0, MLWeights);
+      chunkFirst = ievent;
+    }
+
     // print progress
     if( ievent > 0 && ievent % reportFrac == 0 ) {
       double duration     = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
@@ -424,19 +855,18 @@ void DecisionTree::UpdateWeights(std::vector<float> * MLWeights) const
       m_log << Log::VERBOSE << "FillNodes() : ---> processed : " << std::setw(4) << 100*ievent/maxEvent << "\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time : " << std::setw(4) << static_cast<int>(timeEstimate) << " sec"<< Log::endl(); 
     }
     
-    // get event index
-    long index = indices->at(ievent);
+    // get event index (skipping events which are not in the sub-sample)
+    if ( poisson && (*multiplicities)[ievent] == 0 ) continue;
+    long index = poisson ? ievent : indices->at(ievent);
 
     // continue if this event was already updated (when using bagging 'with replacement')
-    if ( ievent > 0 && index == indices->at(ievent - 1)) continue;
+    if ( ! poisson && ievent > 0 && index == indices->at(ievent - 1)) continue;
     
-    // get event
-    tree->GetEntry( index );
- 
     // update weights vector
-    MLWeights->at( index ) *= GetWeight();
+    MLWeight[index] *= GetWeight(cache, index);
 
   }
+  ReleaseEvents(SOURCE, chunkFirst, maxEvent, 0, MLWeights);
 
   // print out
   double duration  = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
@@ -446,19 +876,147 @@ void DecisionTree::UpdateWeights(std::vector<float> * MLWeights) const
 }
 
 
-float DecisionTree::GetWeight() const
+void DecisionTree::ReleaseEvents(INPUT input, long first, long last, const ScratchBuffer * nodeIndices, const ScratchBuffer * MLWeights) const
+{
+
+  // switch target/source
+  const EventCache * cache = 0;
+  const std::vector<long> * indices = 0;
+  const std::vector<unsigned char> * multiplicities = 0;
+  GetSample(input, cache, indices, multiplicities);
+  if ( last <= first ) return;
+
+  // get range of event indices (the indices of the sub-sample are in ascending order)
+  long firstEvent = multiplicities->empty() ? (*indices)[first] : first;
+  long lastEvent  = multiplicities->empty() ? (*indices)[last - 1] + 1 : last;
+
+  // release cached events, node indices and ML weights
+  cache->Release(firstEvent, lastEvent);
+  if ( nodeIndices ) nodeIndices->Release(firstEvent*sizeof(int), (lastEvent - firstEvent)*sizeof(int));
+  if ( MLWeights ) MLWeights->Release(firstEvent*sizeof(float), (lastEvent - firstEvent)*sizeof(float));
+
+}
+
+
+float DecisionTree::GetWeight(const float * features) const
 {
   
-  // to identify which node the current event belongs to, get the first node in the tree
-  const Node * node = FirstNode();
+  // compiled tree
+  if ( m_function ) return m_function(features);
+
+  // start at the first node, and propagate down the tree until reaching a final node (encoded as a negative position)
+  int inode = m_nNodeArray > 0 ? 0 : ~0;
+  while ( inode >= 0 ) {
+    const FlatNode & node = m_nodeArray[inode];
+    inode = node.output[ features[node.variable] >= node.cutValue ];
+  }
+
+  // return the weight 
+  return m_weightArray[~inode];
+
+}
+
+
+void DecisionTree::GetWeights(const float * features, unsigned int nVariables, int nEvents, float * weights) const
+{
+
+  // compiled tree
+  if ( m_function ) {
+    for (int ievent = 0; ievent < nEvents; ++ievent) weights[ievent] = m_function(features + ievent*nVariables);
+    return;
+  }
 
-  // and then propagate down the tree until reaching a final node
-  while(node->Status() != Node::FINAL) {
-    node = node->OutputBranch()->OutputNode(); 
+  // walk all events of the batch through the tree (the flat nodes stay in cache for the whole batch)
+  const FlatNode * nodes = m_nodeArray;
+  int firstNode = m_nNodeArray > 0 ? 0 : ~0;
+  for (int ievent = 0; ievent < nEvents; ++ievent) {
+    const float * event = features + ievent*nVariables;
+    int inode = firstNode;
+    while ( inode >= 0 ) {
+      const FlatNode & node = nodes[inode];
+      inode = node.output[ event[node.variable] >= node.cutValue ];
+    }
+    weights[ievent] = m_weightArray[~inode];
+  }
+
+}
+
+
+float DecisionTree::GetWeight(const EventCache * cache, long ievent) const
+{
+  
+  // start at the first node, and propagate down the tree until reaching a final node (encoded as a negative position)
+  int inode = m_nNodeArray > 0 ? 0 : ~0;
+  while ( inode >= 0 ) {
+    const FlatNode & node = m_nodeArray[inode];
+    inode = node.output[ static_cast<int>(cache->Bin(node.variable, ievent)) >= node.cutBin ];
   }
 
   // return the weight 
-  return node->GetWeight();
+  return m_weightArray[~inode];
+
+}
+
+
+void DecisionTree::Compile()
+{
+
+  // start from the first node
+  m_flatNodes.clear();
+  m_flatWeights.clear();
+  CompileNode( FirstNode() );
+
+  // evaluate from the vectors
+  m_nodeArray    = m_flatNodes.data();
+  m_nNodeArray   = m_flatNodes.size();
+  m_weightArray  = m_flatWeights.data();
+  m_nWeightArray = m_flatWeights.size();
+
+}
+
+
+int DecisionTree::CompileNode(const Node * node)
+{
+
+  // final node : store weight
+  if ( node->Status() == Node::FINAL ) {
+    m_flatWeights.push_back( node->GetWeight() );
+    return ~static_cast<int>(m_flatWeights.size() - 1);
+  }
+
+  // get output branches
+  const Branch * low  = node->OutputBranch(false);
+  const Branch * high = node->OutputBranch(true);
+  if ( ! low || ! high ) {
+    m_log << Log::ERROR << "CompileNode() : Node (status = " << node->StatusStr() << ") is missing an output branch!" << Log::endl();
+    throw(0);
+  }
+
+  // reserve position of this node, and then add the output nodes (depth-first)
+  int position = m_flatNodes.size();
+  m_flatNodes.push_back( FlatNode() );
+  int outputLow  = CompileNode( low ->OutputNode() );
+  int outputHigh = CompileNode( high->OutputNode() );
+
+  // set node
+  const Branch::Cut & cut = high->CutObject();
+  FlatNode & flatNode = m_flatNodes[position];
+  flatNode.variable  = cut.GetVariable()->Index();
+  flatNode.cutValue  = cut.CutValue();
+  flatNode.cutBin    = cut.CutBin();
+  flatNode.output[0] = outputLow;
+  flatNode.output[1] = outputHigh;
+  
+  return position;
+
+}
+
+
+Node * DecisionTree::NewNode(Branch * input)
+{
+
+  m_nodePool.emplace_back(input, m_nodeSettings);
+  return &m_nodePool.back();
 
 }
 
@@ -483,9 +1041,9 @@ void DecisionTree::AddNodeToTree(const Node * node)
 const Node * DecisionTree::FirstNode() const
 {
 
-  // check if there are any nodes
+  // check if there are any nodes (trees read from flat arrays have none)
   if ( m_nodes.size() == 0 ) {
-    m_log << Log::ERROR << "FirstNode() : Number of nodes = " << m_nodes.size() << Log::endl();
+    m_log << Log::ERROR << "FirstNode() : Number of nodes = " << m_nodes.size() << " (trees read from a binary weights file only have flat arrays)" << Log::endl();
     throw(0);
   }
 
@@ -513,6 +1071,12 @@ const Node * DecisionTree::FirstNode() const
 const std::vector<const Node *> DecisionTree::FinalNodes() const
 {
 
+  // check if there are any nodes (trees read from flat arrays have none)
+  if ( m_nodes.empty() ) {
+    m_log << Log::ERROR << "FinalNodes() : Tree has no nodes (trees read from a binary weights file only have flat arrays)" << Log::endl();
+    throw(0);
+  }
+
   // initialize set of nodes
   std::vector<const Node *> finalNodes;
 
@@ -535,15 +1099,17 @@ const std::vector<const Node *> DecisionTree::FinalNodes() const
 }
 
 
-void DecisionTree::Write(std::ofstream & file, float normalization) const
+void DecisionTree::Write(std::ofstream & file, int itree, float normalization) const
 {
 
-  // instantiate tree counter
-  static int counter = 1;
+  // the text format needs the sums of weights of the final nodes, which are not kept in the flat arrays
+  if ( m_nodes.empty() ) {
+    m_log << Log::ERROR << "Write() : Tree was read from flat arrays (binary weights file) and has no nodes to write" << Log::endl();
+    throw(0);
+  }
 
   // initial print
-  file << "# Decision Tree : " << counter << "\n"; 
-  ++counter;
+  file << "# Decision Tree : " << itree + 1 << "\n"; 
 
   // print weights and corresponding cuts
   const std::vector<const Node *> & finalNodes = FinalNodes();
@@ -556,19 +1122,9 @@ void DecisionTree::Write(std::ofstream & file, float normalization) const
     const Branch * b = node->InputBranch();
     while ( b ) {
 
-      // get cut object
-      const Branch::Cut * cut = b->CutObject();
-      const Branch::Smaller * lt = dynamic_cast<const Branch::Smaller *>(cut);
-      const Branch::Greater * gt = dynamic_cast<const Branch::Greater *>(cut);    
-      
-      // check if valid
-      if ( (lt && gt) || (!lt && !gt) ) {
-	m_log << Log::ERROR << "Write() : Couldn't determine if greater or smaller!" << Log::endl();
-	throw(0);
-      }
-
       // print cut
-      file << cut->GetVariable()->Name() << (lt ? "<" : ">") << cut->CutValue() << "|";
+      const Branch::Cut & cut = b->CutObject();
+      file << cut.GetVariable()->Name() << (cut.IsGreater() ? ">" : "<") << cut.CutValue() << "|";
 	
       // update branch
       b = b->InputNode()->InputBranch();
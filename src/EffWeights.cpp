@@ -100,6 +100,7 @@ int main(int argc, char * argv[]) {
     source->GetEntry( ievent );
 
     // get weight
+    Variables::Read();
     for (const Variable * var : Variables::Get()) {
       effFunc.SetVariable((var->Name()).c_str(), var->Value());
     }
@@ -2,6 +2,7 @@
 #include "Event.h"
 #include "Config.h"
 #include "Store.h"
+#include "Variables.h"
 
 // preprocessor macro inserting code which connects TTree and Event
 #define VARIABLE(name, type) ConnectVariable<type>(#name, tree);
@@ -34,6 +35,7 @@ void Event::ConnectAllVariables(TTree * tree, bool disableOtherBranches, bool co
   
   // connect reweighting variables
   #include "VARIABLES"
+  Variables::Connect();
 
   // connect event weight
   if (connectEventWeight) {
@@ -0,0 +1,223 @@
+// local includes
+#include "EventCache.h"
+#include "Event.h"
+#include "Config.h"
+#include "Variable.h"
+#include "Variables.h"
+#include "HistDefs.h"
+#include "Schema.h"
+#include "Communicator.h"
+
+// stl includes
+#include <ctime>
+#include <limits>
+#include <algorithm>
+
+// ROOT includes
+#include "TTree.h"
+
+
+
+EventCache::EventCache(TTree * tree) :
+  m_name(tree->GetName()),
+  m_entries(0),
+  m_firstEntry(0),
+  m_totalEntries(0),
+  m_nVariables(0),
+  m_values(),
+  m_weights(),
+  m_bins(),
+  m_wideBins(false),
+  m_log("EventCache")
+{
+
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+  // read TTree
+  Fill(tree);
+
+}
+
+
+void EventCache::Fill(TTree * tree)
+{
+
+  // get variables and intrinsic event weight
+  const std::vector<const Variable *> & variables = Variables::Get();
+  const std::string & eventWeightName = Config::Instance().get<std::string>("EventWeightVariableName");
+  const float & eventWeight = Event::Instance().get<float>(eventWeightName);
+
+  // get this process' shard of the entries
+  long lastEntry = 0;
+  m_totalEntries = tree->GetEntries();
+  Communicator::Instance().Shard(m_totalEntries, m_firstEntry, lastEntry);
+
+  // allocate columns
+  std::string directory = ScratchBuffer::Directory();
+  m_entries = lastEntry - m_firstEntry;
+  m_nVariables = variables.size();
+  m_values .Allocate(m_nVariables*m_entries*sizeof(float), directory);
+  m_weights.Allocate(m_entries*sizeof(float), directory);
+  float * columns = m_values .Data<float>();
+  float * weights = m_weights.Data<float>();
+
+  // prepare for loop over tree entries
+  long reportFrac = m_entries/(m_entries > 100000 ? 10 : 1) + 1;
+  m_log << Log::INFO << "Fill() : Caching events (" << m_name << ") : "  << m_entries << Log::endl();
+  std::clock_t start = std::clock();
+
+  // Loop over tree entries
+  float values[Schema::NVARIABLES];
+  long chunkSize = ChunkSize();
+  long chunkFirst = 0;
+  for (long ievent = 0; ievent < m_entries; ++ievent) {
+
+    // write finished chunk to the scratch files
+    if ( ievent - chunkFirst == chunkSize ) {
+      Release(chunkFirst, ievent);
+      chunkFirst = ievent;
+    }
+
+    // print progress
+    if( ievent > 0 && ievent % reportFrac == 0 ) {
+      double duration     = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);
+      double frequency    = static_cast<double>(ievent) / duration;
+      double timeEstimate = static_cast<double>(m_entries - ievent) / frequency;
+      m_log << Log::VERBOSE << "Fill() : ---> processed : " << std::setw(4) << 100*ievent/m_entries << "\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time : " << std::setw(4) << static_cast<int>(timeEstimate) << " sec"<< Log::endl();
+    }
+
+    // load event (this is the only time the TTree is read)
+    tree->GetEntry( m_firstEntry + ievent );
+
+    // store values
+    Variables::GetValues(values);
+    for (unsigned int ivar = 0; ivar < m_nVariables; ++ivar) {
+      columns[ivar*m_entries + ievent] = values[ivar];
+    }
+    weights[ievent] = eventWeight;
+
+  }
+  Release(chunkFirst, m_entries);
+
+  // print out
+  double duration  = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);
+  double frequency = static_cast<double>(m_entries) / duration;
+  m_log << Log::VERBOSE << "Fill() : ---> processed :  100\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time :    0 sec"<< Log::endl();
+
+}
+
+
+void EventCache::Quantize(const HistDefs * histDefs)
+{
+
+  // get histogram definitions (same order as the cached columns)
+  const std::vector<HistDefs::Entry> & entries = histDefs->GetEntries();
+  if ( entries.size() != m_nVariables ) {
+    m_log << Log::ERROR << "Quantize() : Number of histogram definitions (" << entries.size() << ") doesn't match number of cached variables (" << m_nVariables << ")" << Log::endl();
+    throw(0);
+  }
+
+  // choose width of bin indices (including underflow and overflow bins)
+  int maxBins = 0;
+  for (const HistDefs::Entry & entry : entries) {
+    if ( entry.Nbins() + 2 > maxBins ) maxBins = entry.Nbins() + 2;
+  }
+  if ( maxBins - 1 > std::numeric_limits<unsigned short>::max() ) {
+    m_log << Log::ERROR << "Quantize() : Too many bins (" << maxBins << ") to store as bin indices" << Log::endl();
+    throw(0);
+  }
+  m_wideBins = maxBins - 1 > std::numeric_limits<unsigned char>::max();
+  m_log << Log::INFO << "Quantize() : Converting events (" << m_name << ") to " << (m_wideBins ? 16 : 8) << "-bit bin indices" << Log::endl();
+
+  // convert columns (chunk by chunk)
+  m_bins.Allocate(m_nVariables*m_entries*(m_wideBins ? sizeof(unsigned short) : sizeof(unsigned char)), ScratchBuffer::Directory());
+  const float * values = m_values.Data<float>();
+  unsigned short * bins16 = m_bins.Data<unsigned short>();
+  unsigned char  * bins8  = m_bins.Data<unsigned char >();
+  long chunkSize = ChunkSize();
+  for (long first = 0; first < m_entries; first += chunkSize) {
+    long last = std::min(first + chunkSize, m_entries);
+    for (unsigned int ivar = 0; ivar < m_nVariables; ++ivar) {
+      const HistDefs::Entry & entry = entries[ivar];
+      for (long i = ivar*m_entries + first; i < ivar*m_entries + last; ++i) {
+        float x = values[i];
+        int bin = entry.FindBin(x);
+        // align with the float cut values the trees are applied with (x >= cutValue)
+        while ( bin <= entry.Nbins() && x >= static_cast<float>(entry.BinLowEdge(bin + 1)) ) ++bin;
+        while ( bin >= 1 && x < static_cast<float>(entry.BinLowEdge(bin)) ) --bin;
+        if ( m_wideBins ) bins16[i] = static_cast<unsigned short>(bin);
+        else              bins8 [i] = static_cast<unsigned char >(bin);
+      }
+    }
+    Release(first, last);
+  }
+
+}
+
+
+const std::string & EventCache::Name() const
+{
+
+  return m_name;
+
+}
+
+
+long EventCache::Entries() const
+{
+
+  return m_entries;
+
+}
+
+
+const float * EventCache::Column(unsigned int ivar) const
+{
+
+  if ( ivar >= m_nVariables ) {
+    m_log << Log::ERROR << "Column() : Variable index " << ivar << " out of range (" << m_nVariables << " variables)" << Log::endl();
+    throw(0);
+  }
+
+  return m_values.Data<float>() + ivar*m_entries;
+
+}
+
+
+const float * EventCache::Weights() const
+{
+
+  return m_weights.Data<float>();
+
+}
+
+
+long EventCache::ChunkSize(unsigned long extraBytesPerEvent) const
+{
+
+  // values, bin indices and weight of each event
+  unsigned long bytesPerEvent = m_nVariables*(sizeof(float) + (m_wideBins ? sizeof(unsigned short) : sizeof(unsigned char))) + sizeof(float);
+
+  return ScratchBuffer::ChunkSize(m_entries, bytesPerEvent + extraBytesPerEvent);
+
+}
+
+
+void EventCache::Release(long first, long last) const
+{
+
+  if ( last <= first ) return;
+  unsigned long binSize = m_wideBins ? sizeof(unsigned short) : sizeof(unsigned char);
+  for (unsigned int ivar = 0; ivar < m_nVariables; ++ivar) {
+    m_values.Release((ivar*m_entries + first)*sizeof(float), (last - first)*sizeof(float));
+    m_bins  .Release((ivar*m_entries + first)*binSize, (last - first)*binSize);
+  }
+  m_weights.Release(first*sizeof(float), (last - first)*sizeof(float));
+
+}
@@ -0,0 +1,49 @@
+// local includes
+#include "EventReader.h"
+#include "Config.h"
+
+// ROOT includes
+#include "TTree.h"
+
+
+
+EventReader::EventReader(TTree * tree) :
+  m_tree(tree),
+  m_values(),
+  m_log("EventReader")
+{
+
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+  // only read the reweighting variables
+  m_tree->SetBranchStatus("*", 0);
+  #define VARIABLE(name, type)				\
+    m_tree->SetBranchStatus(#name, 1);			\
+    m_tree->SetBranchAddress(#name, &m_values.name);	\
+    m_log << Log::DEBUG << "EventReader() : Connecting " << #name << Log::endl();
+  #include "VARIABLES"
+  #undef VARIABLE
+
+}
+
+
+void EventReader::GetEntry(long ientry)
+{
+
+  m_tree->GetEntry( ientry );
+
+}
+
+
+void EventReader::GetValues(float * values) const
+{
+
+  Schema::ToFeatures(m_values, values);
+
+}
@@ -4,9 +4,13 @@
 #include "DecisionTree.h"
 #include "Config.h"
 #include "HistDefs.h"
+#include "EventCache.h"
+#include "Variables.h"
+#include "Context.h"
 
 // stl includes
 #include <vector>
+#include <algorithm>
 
 // ROOT includes
 #include "TTree.h"
@@ -58,18 +62,23 @@ void ExtraTrees::Initialize()
 {
 
   // check if bagging is enabled
-  static bool bagging = false;
+  bool bagging = false;
   Config::Instance().getif<bool>("Bagging", bagging); 
   if ( ! bagging ) {
     m_log << Log::ERROR << "Initialize() : Bagging needs to be enabled. In config file : 'bool bagging = true'" << Log::endl();
     throw(0);    
   }
+
+  // read source and target events into memory
+  Algorithm::FillCache();
   
   // get histogram definitions
   m_histDefs = new HistDefs;
   m_histDefs->Initialize();
-  m_histDefs->UpdateVariableRanges(m_target);
-  m_histDefs->UpdateVariableRanges(m_source);
+  m_histDefs->UpdateVariableRanges(m_cacheTarget);
+  m_histDefs->UpdateVariableRanges(m_cacheSource);
+  m_cacheTarget->Quantize(m_histDefs);
+  m_cacheSource->Quantize(m_histDefs);
   for (const HistDefs::Entry & entry : m_histDefs->GetEntries()) {
     m_log << Log::INFO << "Initialize() : Histogram name : " << entry.Name() << ", range = ( " << entry.Xmin() << " , " << entry.Xmax() << " )" << Log::endl();
   }
@@ -85,25 +94,27 @@ void ExtraTrees::Process()
   
   // grow decision trees
   int ntree = Config::Instance().get<int>("NumberOfTrees");
-  for (int itree = 0; itree < ntree; ++itree) {
-
-    // bagging (prepare event indices)
-    Algorithm::PrepareIndices();
-    
-    // create tree
-    DecisionTree * dtree = new DecisionTree(m_source, m_target, m_indicesSource, m_indicesTarget, m_histDefs);
-    dtree->GrowTree();
-    
-    // add tree to forest
-    forest->AddTree( dtree );
-
-  }
+  Algorithm::GrowForest(forest, ntree, m_histDefs);
   
   // add forest to internal vector
   m_forests.clear();
   m_forests.push_back( forest );
 
+}
+
 
+DecisionTree * ExtraTrees::GrowTree(Context & context, int nThreads)
+{
+
+  // bagging (prepare event indices)
+  Algorithm::PrepareIndices(context);
+    
+  // create tree
+  DecisionTree * dtree = new DecisionTree(context);
+  dtree->SetNumberOfThreads(nThreads);
+  dtree->GrowTree();
+
+  return dtree;
 
 }
 
@@ -114,56 +125,18 @@ void ExtraTrees::Write(std::ofstream & outfile) {
   const std::vector<const DecisionTree *> & decisionTrees = m_forests.at(0)->GetTrees();
 
   // write trees to file
-  float norm = GetNormalization();
-  for (const DecisionTree * dtree : decisionTrees) {
-    dtree->Write( outfile, norm );
+  float norm = Normalization();
+  for (unsigned int itree = 0; itree < decisionTrees.size(); ++itree) {
+    decisionTrees[itree]->Write( outfile, itree, norm );
   }
 
 }
 
 
-void ExtraTrees::GetWeight(float & weight, float & error) const
+void ExtraTrees::GetWeights(const float * features, long nEvents, float * weights, float * errors) const
 {
 
-  // reset weight/error
-  weight = 0;
-  error  = 0;
-  
-  // get total number of trees
-  static int nTreeTotal = 0;
-  if (nTreeTotal == 0) {
-    for (const Forest * forest : m_forests) {
-      nTreeTotal += forest->GetTrees().size();
-    }
-  }
-  
-  // declare vector to hold error
-  static std::vector<float> error_vec( nTreeTotal );
-  
-  // loop over forests
-  int iTree = 0;
-  for (const Forest * forest : m_forests) {
-
-    // loop over trees
-    for (const DecisionTree * tree : forest->GetTrees()) {     
-      float w = tree->GetWeight();
-      weight += w;
-      error_vec.at( iTree ) = w;
-    }
-
-    // increment tree counter
-    ++iTree;
-    
-  }
-  
-  // finalise weight
-  weight /= static_cast<float>( nTreeTotal );
+  AverageTrees(m_forests, features, nEvents, weights, errors);
 
-  // finalise error
-  for (float e : error_vec) {
-    error += pow(e - weight, 2);
-  }
-  error = sqrt( error/(nTreeTotal - 1) );
-  
 }
 
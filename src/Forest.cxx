@@ -1,8 +1,10 @@
 // local includes
 #include "Forest.h"
 #include "DecisionTree.h"
+#include "QuickScorer.h"
 #include "Branch.h"
 #include "Variables.h"
+#include "Variable.h"
 #include "Config.h"
 
 // stl includes
@@ -12,13 +14,86 @@
 #include <algorithm>
 #include <utility>
 #include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <iomanip>
+
+// system includes
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
 
 
 Log Forest::m_log("Forest");
 
 
+// layout of binary weights files (all sections start at multiples of 8 bytes)
+namespace {
+
+  const char BINARY_MAGIC[8] = {'M', 'L', 'R', 'W', 'B', 'I', 'N', '\0'};
+  const uint32_t BINARY_VERSION = 1;
+  const uint32_t BINARY_BYTEORDER = 0x01020304;
+
+  struct BinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t nVariables;
+    uint32_t nForests;
+    uint32_t nTrees;
+    uint32_t namesSize;   // size of the variable table ('\0'-terminated names, in the order of Variables::Get())
+    uint64_t fileSize;
+  };
+
+  struct BinaryTree {
+    uint64_t nodeOffset;
+    uint64_t weightOffset;
+    uint32_t nNodes;
+    uint32_t nWeights;
+  };
+
+  uint64_t Align(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+
+  // write constant of generated source
+  std::string FloatLiteral(float value)
+  {
+    if ( std::isnan(value) ) return "std::numeric_limits<float>::quiet_NaN()";
+    if ( std::isinf(value) ) return value > 0 ? "std::numeric_limits<float>::infinity()" : "-std::numeric_limits<float>::infinity()";
+    std::ostringstream literal;
+    literal << std::setprecision(9) << value;
+    if ( literal.str().find_first_of(".e") == std::string::npos ) literal << ".";
+    literal << "f";
+    return literal.str();
+  }
+
+  // write node of generated source (same convention as the flat arrays: values at or above the cut go to the second output)
+  void WriteSourceNode(std::ofstream & file, const DecisionTree * tree, unsigned int itree, int inode, const std::string & indent)
+  {
+    if ( inode < 0 ) {
+      file << indent << "return leaves" << itree << "[" << ~inode << "];\n";
+      return;
+    }
+    const DecisionTree::FlatNode & node = tree->FlatNodes()[inode];
+    file << indent << "if ( x[" << node.variable << "] >= " << FloatLiteral(node.cutValue) << " ) {\n";
+    WriteSourceNode(file, tree, itree, node.output[1], indent + "  ");
+    file << indent << "}\n";
+    file << indent << "else {\n";
+    WriteSourceNode(file, tree, itree, node.output[0], indent + "  ");
+    file << indent << "}\n";
+  }
+
+}
+
+
 Forest::Forest() :
-  m_trees()
+  m_trees(),
+  m_quickScorer(),
+  m_mapping()
 {
 
   std::string str_level;
@@ -32,7 +107,9 @@ Forest::Forest() :
 
 
 Forest::Forest(const std::vector<const DecisionTree *> trees) :
-  m_trees(trees)
+  m_trees(trees),
+  m_quickScorer(),
+  m_mapping()
 {
 
   std::string str_level;
@@ -42,6 +119,9 @@ Forest::Forest(const std::vector<const DecisionTree *> trees) :
     m_log.SetLevel(level);
   }
 
+  // shallow trees are evaluated feature by feature
+  if ( QuickScorer::Supports(m_trees) ) m_quickScorer.reset( new QuickScorer(m_trees) );
+
 }
 
 
@@ -56,6 +136,7 @@ void Forest::AddTree(const DecisionTree * tree)
 
   // add decision tree to the forest
   m_trees.push_back( tree );
+  m_quickScorer.reset();
   
 }
 
@@ -68,6 +149,23 @@ const std::vector<const DecisionTree *> & Forest::GetTrees() const
 }
 
 
+void Forest::GetTreeWeights(const float * features, unsigned int nVariables, int nEvents, float * treeWeights) const
+{
+
+  // feature-major evaluation
+  if ( m_quickScorer ) {
+    m_quickScorer->GetTreeWeights(features, nVariables, nEvents, treeWeights);
+    return;
+  }
+
+  // evaluate tree by tree
+  for (unsigned int itree = 0; itree < m_trees.size(); ++itree) {
+    m_trees[itree]->GetWeights(features, nVariables, nEvents, treeWeights + itree*nEvents);
+  }
+
+}
+
+
 const std::vector<const Forest *> Forest::ReadForests(const std::string & weightsFileName)
 {
 
@@ -83,6 +181,19 @@ const std::vector<const Forest *> Forest::ReadForests(const std::string & weight
   std::ifstream weightsFile;
   m_log << Log::INFO << "ReadForests() : Opening file " << weightsFileName << Log::endl();
   weightsFile.open(weightsFileName.c_str());
+  if ( ! weightsFile.is_open() ) {
+    m_log << Log::ERROR << "ReadForests() : Couldn't open file " << weightsFileName << Log::endl();
+    throw(0);
+  }
+
+  // binary files are memory-mapped instead
+  char magic[sizeof(BINARY_MAGIC)] = {0};
+  weightsFile.read(magic, sizeof(magic));
+  if ( weightsFile.gcount() == sizeof(magic) && std::memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0 ) {
+    return ReadBinary(weightsFileName);
+  }
+  weightsFile.clear();
+  weightsFile.seekg(0);
  
   // vector of forests
   std::vector<const Forest *> forests;
@@ -91,7 +202,7 @@ const std::vector<const Forest *> Forest::ReadForests(const std::string & weight
   std::vector<const DecisionTree *> trees;
 
   // single tree (collection of final node weights and corresponding cuts)
-  std::vector<std::pair<float, std::vector<const Branch::Cut *> > > treeReadIn;
+  std::vector<std::pair<float, std::vector<Branch::Cut> > > treeReadIn;
  
   // read lines
   m_log << Log::INFO << "ReadForests() : Reading file " << weightsFileName << Log::endl();
@@ -119,12 +230,6 @@ const std::vector<const Forest *> Forest::ReadForests(const std::string & weight
       if (treeReadIn.size()) {
 	trees.push_back( new DecisionTree(treeReadIn) );
       }
-      for (unsigned int i = 0; i < treeReadIn.size(); ++i) {
-	std::vector<const Branch::Cut *> cuts = treeReadIn.at(i).second;
-	for (unsigned int j = 0; j < cuts.size(); ++j) {
-	  delete cuts.at(j);
-	}
-      }
       treeReadIn.clear();
       continue;
     }
@@ -157,7 +262,7 @@ const std::vector<const Forest *> Forest::ReadForests(const std::string & weight
     pos1 = line.find(':', pos2) + 1;
     
     // branches for this weight
-    std::vector<const Branch::Cut *> cuts;
+    std::vector<Branch::Cut> cuts;
 
     // retrieve cuts from this line and convert them to branches
     while (pos1 != std::string::npos) {
@@ -176,13 +281,13 @@ const std::vector<const Forest *> Forest::ReadForests(const std::string & weight
 	std::string name  = buffer.substr(0, posLT);
 	std::istringstream( buffer.substr(posLT + 1) ) >> value;
 	m_log << Log::DEBUG << "ReadForests() : " << name << " < " << value << Log::endl();
-	cuts.push_back( new Branch::Smaller(Variables::Get(name), value) );
+	cuts.emplace_back(Variables::Get(name), value, false);
       }
       else if (posGT != std::string::npos) {
 	std::string name  = buffer.substr(0, posGT);
 	std::istringstream( buffer.substr(posGT + 1) ) >> value;
 	m_log << Log::DEBUG << "ReadForests() : " << name << " > " << value << Log::endl();
-	cuts.push_back( new Branch::Greater(Variables::Get(name), value) );
+	cuts.emplace_back(Variables::Get(name), value, true);
       }
       
       pos1 = (next == std::string::npos ? next : next + 1);
@@ -205,3 +310,284 @@ const std::vector<const Forest *> Forest::ReadForests(const std::string & weight
   return forests;
 
 }
+
+
+void Forest::WriteBinary(const std::vector<const Forest *> & forests, const std::string & fileName)
+{
+
+  // variable table
+  std::string names;
+  for (const Variable * var : Variables::Get()) {
+    names += var->Name();
+    names += '\0';
+  }
+
+  // tree table (the flat arrays follow the tables)
+  std::vector<uint32_t> nTrees;
+  std::vector<BinaryTree> treeTable;
+  std::vector<const DecisionTree *> trees;
+  for (const Forest * forest : forests) {
+    nTrees.push_back( forest->GetTrees().size() );
+    for (const DecisionTree * tree : forest->GetTrees()) trees.push_back( tree );
+  }
+  uint64_t offset = Align(sizeof(BinaryHeader)) + Align(names.size()) + Align(nTrees.size()*sizeof(uint32_t)) + Align(trees.size()*sizeof(BinaryTree));
+  for (const DecisionTree * tree : trees) {
+    BinaryTree entry;
+    entry.nNodes       = tree->NumberOfFlatNodes();
+    entry.nWeights     = tree->NumberOfFlatWeights();
+    entry.nodeOffset   = offset;
+    offset            += Align(entry.nNodes*sizeof(DecisionTree::FlatNode));
+    entry.weightOffset = offset;
+    offset            += Align(entry.nWeights*sizeof(float));
+    treeTable.push_back( entry );
+  }
+
+  // header
+  BinaryHeader header;
+  std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.version    = BINARY_VERSION;
+  header.byteOrder  = BINARY_BYTEORDER;
+  header.nVariables = Variables::Get().size();
+  header.nForests   = forests.size();
+  header.nTrees     = trees.size();
+  header.namesSize  = names.size();
+  header.fileSize   = offset;
+
+  // write to temporary file, and move it in place at the end (processes which still map the old file are not affected)
+  std::string tmpFileName = fileName + ".tmp";
+  std::ofstream file(tmpFileName.c_str(), std::ios::binary);
+  if ( ! file.is_open() ) {
+    m_log << Log::ERROR << "WriteBinary() : Couldn't open file " << tmpFileName << Log::endl();
+    throw(0);
+  }
+  auto write = [&file](const void * data, uint64_t size) {
+    static const char padding[8] = {0};
+    file.write(static_cast<const char *>(data), size);
+    file.write(padding, Align(size) - size);
+  };
+  write(&header, sizeof(header));
+  write(names.data(), names.size());
+  write(nTrees.data(), nTrees.size()*sizeof(uint32_t));
+  write(treeTable.data(), treeTable.size()*sizeof(BinaryTree));
+  for (const DecisionTree * tree : trees) {
+    write(tree->FlatNodes(), tree->NumberOfFlatNodes()*sizeof(DecisionTree::FlatNode));
+    write(tree->FlatWeights(), tree->NumberOfFlatWeights()*sizeof(float));
+  }
+  file.close();
+  if ( ! file || std::rename(tmpFileName.c_str(), fileName.c_str()) != 0 ) {
+    m_log << Log::ERROR << "WriteBinary() : Couldn't write file " << fileName << Log::endl();
+    throw(0);
+  }
+  m_log << Log::INFO << "WriteBinary() : Wrote " << header.nTrees << " trees in " << header.nForests << " forest(s) to " << fileName << Log::endl();
+
+}
+
+
+const std::vector<const Forest *> Forest::ReadBinary(const std::string & fileName)
+{
+
+  // map file
+  int fd = open(fileName.c_str(), O_RDONLY);
+  struct stat status;
+  if ( fd < 0 || fstat(fd, &status) != 0 ) {
+    m_log << Log::ERROR << "ReadBinary() : Couldn't open file " << fileName << Log::endl();
+    throw(0);
+  }
+  uint64_t fileSize = status.st_size;
+  void * address = fileSize >= sizeof(BinaryHeader) ? mmap(0, fileSize, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if ( address == MAP_FAILED ) {
+    m_log << Log::ERROR << "ReadBinary() : Couldn't map file " << fileName << Log::endl();
+    throw(0);
+  }
+  std::shared_ptr<const void> mapping(address, [fileSize](const void * p) { munmap(const_cast<void *>(p), fileSize); });
+  const char * data = static_cast<const char *>(address);
+
+  // check header
+  const BinaryHeader & header = *reinterpret_cast<const BinaryHeader *>(data);
+  if ( header.byteOrder != BINARY_BYTEORDER || header.version != BINARY_VERSION || header.fileSize != fileSize ) {
+    m_log << Log::ERROR << "ReadBinary() : Unsupported or truncated file " << fileName << " (version " << header.version << ", " << fileSize << " of " << header.fileSize << " bytes)" << Log::endl();
+    throw(0);
+  }
+
+  // check variables (the variable indices of the nodes refer to the order of Variables::Get())
+  uint64_t offset = Align(sizeof(BinaryHeader));
+  const std::vector<const Variable *> & variables = Variables::Get();
+  const char * name = data + offset;
+  bool sameVariables = header.nVariables == variables.size() && offset + header.namesSize <= fileSize;
+  for (unsigned int ivar = 0; sameVariables && ivar < variables.size(); ++ivar) {
+    sameVariables = static_cast<uint64_t>(name - data) + variables[ivar]->Name().size() < offset + header.namesSize && variables[ivar]->Name() == name;
+    name += variables[ivar]->Name().size() + 1;
+  }
+  if ( ! sameVariables ) {
+    m_log << Log::ERROR << "ReadBinary() : Variables in " << fileName << " don't match the variables in 'inc/VARIABLES'" << Log::endl();
+    throw(0);
+  }
+  offset += Align(header.namesSize);
+
+  // get tables
+  const uint32_t * nTrees = reinterpret_cast<const uint32_t *>(data + offset);
+  offset += Align(header.nForests*sizeof(uint32_t));
+  const BinaryTree * treeTable = reinterpret_cast<const BinaryTree *>(data + offset);
+  offset += Align(header.nTrees*sizeof(BinaryTree));
+  if ( offset > fileSize ) {
+    m_log << Log::ERROR << "ReadBinary() : Truncated tables in file " << fileName << Log::endl();
+    throw(0);
+  }
+
+  // create trees on top of the mapped arrays
+  std::vector<const Forest *> forests;
+  unsigned int itree = 0;
+  for (unsigned int iforest = 0; iforest < header.nForests; ++iforest) {
+    std::vector<const DecisionTree *> trees;
+    for (unsigned int i = 0; i < nTrees[iforest]; ++i, ++itree) {
+      if ( itree >= header.nTrees ) {
+	m_log << Log::ERROR << "ReadBinary() : More trees in forests than in file " << fileName << Log::endl();
+	throw(0);
+      }
+      const BinaryTree & entry = treeTable[itree];
+      if ( entry.nodeOffset + entry.nNodes*sizeof(DecisionTree::FlatNode) > fileSize || entry.weightOffset + entry.nWeights*sizeof(float) > fileSize ) {
+	m_log << Log::ERROR << "ReadBinary() : Tree " << itree << " exceeds file " << fileName << Log::endl();
+	throw(0);
+      }
+      trees.push_back( new DecisionTree(reinterpret_cast<const DecisionTree::FlatNode *>(data + entry.nodeOffset), entry.nNodes, reinterpret_cast<const float *>(data + entry.weightOffset), entry.nWeights) );
+    }
+    Forest * forest = new Forest(trees);
+    forest->m_mapping = mapping;
+    forests.push_back( forest );
+  }
+  m_log << Log::INFO << "ReadBinary() : Mapped " << itree << " trees in " << forests.size() << " forest(s)" << Log::endl();
+
+  return forests;
+
+}
+
+
+unsigned long long Forest::Checksum(const std::vector<const Forest *> & forests)
+{
+
+  // FNV-1a hash of the flat arrays
+  unsigned long long hash = 14695981039346656037ULL;
+  auto add = [&hash](const void * data, unsigned long size) {
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (unsigned long i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+  };
+  for (const Forest * forest : forests) {
+    for (const DecisionTree * tree : forest->GetTrees()) {
+      unsigned int sizes[2] = {tree->NumberOfFlatNodes(), tree->NumberOfFlatWeights()};
+      add(sizes, sizeof(sizes));
+      for (unsigned int inode = 0; inode < sizes[0]; ++inode) {
+	const DecisionTree::FlatNode & node = tree->FlatNodes()[inode];
+	add(&node.variable, sizeof(node.variable));
+	add(&node.cutValue, sizeof(node.cutValue));
+	add(node.output, sizeof(node.output));
+      }
+      add(tree->FlatWeights(), sizes[1]*sizeof(float));
+    }
+  }
+
+  return hash;
+
+}
+
+
+void Forest::WriteSource(const std::vector<const Forest *> & forests, const std::string & fileName)
+{
+
+  // open file
+  std::ofstream file(fileName.c_str());
+  if ( ! file.is_open() ) {
+    m_log << Log::ERROR << "WriteSource() : Couldn't open file " << fileName << Log::endl();
+    throw(0);
+  }
+
+  // header
+  file << "// Generated by CompileForest, do not edit.\n";
+  file << "// Variables (x[i]) :";
+  for (const Variable * var : Variables::Get()) file << " " << var->Name();
+  file << "\n\n#include <limits>\n\n";
+
+  // one function per tree
+  std::vector<const DecisionTree *> trees;
+  for (const Forest * forest : forests) {
+    for (const DecisionTree * tree : forest->GetTrees()) trees.push_back( tree );
+  }
+  file << "namespace {\n\n";
+  for (unsigned int itree = 0; itree < trees.size(); ++itree) {
+    const DecisionTree * tree = trees[itree];
+    file << "constexpr float leaves" << itree << "[" << tree->NumberOfFlatWeights() << "] = {";
+    for (unsigned int ileaf = 0; ileaf < tree->NumberOfFlatWeights(); ++ileaf) {
+      file << (ileaf ? ", " : " ") << FloatLiteral(tree->FlatWeights()[ileaf]);
+    }
+    file << " };\n\n";
+    file << "float tree" << itree << "(const float * x)\n{\n";
+    WriteSourceNode(file, tree, itree, tree->NumberOfFlatNodes() > 0 ? 0 : ~0, "  ");
+    file << "}\n\n";
+  }
+  file << "}\n\n";
+
+  // table of trees (in the order of the forests), and checksum of the forests they were generated from
+  file << "extern \"C\" const unsigned long long MLRW_checksum = " << Checksum(forests) << "ULL;\n";
+  file << "extern \"C\" const unsigned int MLRW_nTrees = " << trees.size() << ";\n";
+  file << "extern \"C\" float (* const MLRW_trees[])(const float *) = {";
+  for (unsigned int itree = 0; itree < trees.size(); ++itree) {
+    file << (itree % 8 ? " " : "\n  ") << "tree" << itree << (itree + 1 < trees.size() ? "," : "");
+  }
+  file << "\n};\n";
+
+  // check
+  file.close();
+  if ( ! file ) {
+    m_log << Log::ERROR << "WriteSource() : Couldn't write file " << fileName << Log::endl();
+    throw(0);
+  }
+  m_log << Log::INFO << "WriteSource() : Wrote " << trees.size() << " trees to " << fileName << Log::endl();
+
+}
+
+
+void Forest::LoadCompiled(const std::vector<const Forest *> & forests, const std::string & libraryName)
+{
+
+  // open library (stays loaded until the end of the program), a bare file name refers to the working directory rather than the library search path
+  std::string libraryPath = libraryName.find('/') == std::string::npos ? "./" + libraryName : libraryName;
+  void * library = dlopen(libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if ( ! library ) {
+    m_log << Log::ERROR << "LoadCompiled() : Couldn't load library " << libraryName << " : " << dlerror() << Log::endl();
+    throw(0);
+  }
+  const unsigned long long * checksum = static_cast<const unsigned long long *>(dlsym(library, "MLRW_checksum"));
+  const unsigned int * nTrees = static_cast<const unsigned int *>(dlsym(library, "MLRW_nTrees"));
+  const DecisionTree::Function * functions = static_cast<const DecisionTree::Function *>(dlsym(library, "MLRW_trees"));
+  if ( ! checksum || ! nTrees || ! functions ) {
+    m_log << Log::ERROR << "LoadCompiled() : Library " << libraryName << " wasn't generated by CompileForest" << Log::endl();
+    throw(0);
+  }
+
+  // check that the library was generated from these forests
+  if ( *checksum != Checksum(forests) ) {
+    m_log << Log::ERROR << "LoadCompiled() : Library " << libraryName << " was generated from different weights (run CompileForest again)" << Log::endl();
+    throw(0);
+  }
+
+  unsigned int nTreesForests = 0;
+  for (const Forest * forest : forests) nTreesForests += forest->GetTrees().size();
+  if ( nTreesForests != *nTrees ) {
+    m_log << Log::ERROR << "LoadCompiled() : Library " << libraryName << " has " << *nTrees << " trees, but the forests have " << nTreesForests << Log::endl();
+    throw(0);
+  }
+
+  // set functions (the forests have just been read, and aren't evaluated yet)
+  unsigned int itree = 0;
+  for (const Forest * forest : forests) {
+    forest->m_quickScorer.reset();
+    for (const DecisionTree * tree : forest->GetTrees()) {
+      tree->SetFunction( functions[itree++] );
+    }
+  }
+  m_log << Log::INFO << "LoadCompiled() : Evaluating " << itree << " trees with " << libraryName << Log::endl();
+
+}
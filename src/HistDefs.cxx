@@ -3,9 +3,11 @@
 #include "Variable.h"
 #include "Variables.h"
 #include "Config.h"
+#include "EventCache.h"
+#include "Communicator.h"
 
-// ROOT includes
-#include "TTree.h"
+// stl includes
+#include <algorithm>
 
 
 HistDefs::HistDefs() :
@@ -38,42 +40,46 @@ void HistDefs::Initialize()
 }
 
 
-void HistDefs::UpdateVariableRanges(TTree * tree)
+void HistDefs::UpdateVariableRanges(const EventCache * cache)
 {
   
-  // prepare for loop over tree entries
-  long maxEvent = tree->GetEntries();
-  long reportFrac = maxEvent/(maxEvent > 100000 ? 10 : 1) + 1;
-  m_log << Log::INFO << "UpdateVariableRanges() : Looping over events (" << tree->GetName() << ") : "  << maxEvent << Log::endl();
-  std::clock_t start = std::clock();
-
-  // Loop over ree entries
-  for (long ievent = 0; ievent < maxEvent; ++ievent) {
-
-    // print progress
-    if( ievent > 0 && ievent % reportFrac == 0 ) {
-      double duration     = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
-      double frequency    = static_cast<double>(ievent) / duration;
-      double timeEstimate = static_cast<double>(maxEvent - ievent) / frequency;
-      m_log << Log::VERBOSE << "UpdateVariableRanges() : ---> processed : " << std::setw(4) << 100*ievent/maxEvent << "\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time : " << std::setw(4) << static_cast<int>(timeEstimate) << " sec"<< Log::endl(); 
+  // prepare for loop over cached events
+  long maxEvent = cache->Entries();
+  m_log << Log::INFO << "UpdateVariableRanges() : Looping over events (" << cache->Name() << ") : "  << maxEvent << Log::endl();
+
+  // update ranges (entries are in the same order as Variables::Get(), and thus as the cached columns), chunk by chunk
+  long chunkSize = cache->ChunkSize();
+  for (long first = 0; first < maxEvent; first += chunkSize) {
+    long last = std::min(first + chunkSize, maxEvent);
+    for (unsigned int ivar = 0; ivar < m_defs.size(); ++ivar) {
+      Entry & entry = m_defs[ivar];
+      const float * column = cache->Column(ivar);
+      float xmin = entry.Xmin();
+      float xmax = entry.Xmax();
+      for (long ievent = first; ievent < last; ++ievent) {
+        float value = column[ievent];
+        if      (value < xmin ) xmin = value;
+        else if (value > xmax ) xmax = value;
+      }
+      entry.SetXmin(xmin);
+      entry.SetXmax(xmax);
     }
-    
-    // load event
-    tree->GetEntry( ievent );
-
-    // update ranges
-    for (Entry & entry : m_defs) {
-      float value = entry.GetVariable()->Value();
-      if      (value < entry.Xmin() ) entry.SetXmin(value);
-      else if (value > entry.Xmax() ) entry.SetXmax(value);
-    }
-
+    cache->Release(first, last);
   }
 
-  // print out
-  double duration  = (std::clock() - start)/static_cast<double>(CLOCKS_PER_SEC);    
-  double frequency = static_cast<double>(maxEvent) / duration;
-  m_log << Log::VERBOSE << "UpdateVariableRanges() : ---> processed :  100\%  ---  frequency : " << std::setw(7) << static_cast<int>(frequency) << " events/sec  ---  time : " << std::setw(4) << static_cast<int>(duration) << " sec  ---  remaining time :    0 sec"<< Log::endl(); 
+  // combine ranges of all event shards
+  std::vector<double> xmin;
+  std::vector<double> xmax;
+  for (const Entry & entry : m_defs) {
+    xmin.push_back(entry.Xmin());
+    xmax.push_back(entry.Xmax());
+  }
+  Communicator::Instance().AllReduceShards(xmin.data(), xmin.size(), Communicator::MIN);
+  Communicator::Instance().AllReduceShards(xmax.data(), xmax.size(), Communicator::MAX);
+  for (unsigned int ivar = 0; ivar < m_defs.size(); ++ivar) {
+    m_defs[ivar].SetXmin(xmin[ivar]);
+    m_defs[ivar].SetXmax(xmax[ivar]);
+  }
 
 }
 
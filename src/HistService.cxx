@@ -37,6 +37,24 @@ void HistService::AddHist(std::string name, int nbins, float xmin, float xmax)
 }
 
 
+void HistService::AddHist(TH1F * hist)
+{
+
+  // check if already exists
+  std::string name = hist->GetName();
+  std::map<std::string, TH1F *>::iterator itr = m_map.find( name );
+  if (itr != m_map.end() ) {
+    m_log << Log::ERROR << "Histogram with name = " << name << " already exists in map!" << Log::endl();
+    throw(0);
+  }
+
+  // add histogram to map
+  hist->SetDirectory(0);
+  m_map[name] = hist;
+
+}
+
+
 TH1F * HistService::GetHist(const std::string & name)
 {
 
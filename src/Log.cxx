@@ -5,6 +5,10 @@
 #include "Log.h"
 
 
+std::string Log::m_processPrefix = "";
+Log::LEVEL  Log::m_processLevel  = Log::DEBUG;
+
+
 Log::Log(const std::string & name, const LEVEL & level, std::ostream & stream) :
   m_outstream(stream),
   m_name(name),
@@ -15,6 +19,15 @@ Log::Log(const std::string & name, const LEVEL & level, std::ostream & stream) :
 }
 
 
+void Log::SetProcess(const std::string & prefix, const LEVEL & level)
+{
+
+  m_processPrefix = prefix;
+  m_processLevel  = level;
+
+}
+
+
 Log::LEVEL Log::StringToLEVEL(const std::string & str_level)
 {
 
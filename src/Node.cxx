@@ -2,9 +2,16 @@
 #include "Node.h"
 #include "Branch.h"
 #include "Event.h"
+#include "EventCache.h"
 #include "Config.h"
 #include "DecisionTree.h"
 #include "Method.h"
+#include "Schema.h"
+#include "Context.h"
+#include "Philox.h"
+#include "Variable.h"
+#include "Variables.h"
+#include "Communicator.h"
 
 // stl includes
 #include <map>
@@ -16,47 +23,98 @@
 
 // ROOT includes
 #include "TTree.h"
-#include "TRandom3.h"
 
 
+namespace {
 
-Node::Node(Branch * input) :
-  m_status(NEW),
-  m_input(input),
-  m_output1(0),
-  m_output2(0),
-  m_weight(0.),
-  m_weightIsSet(false),
-  m_sumSource(-1),
-  m_sumTarget(-1),
-  m_doFeatSampling(false),
-  m_splitMode(NONE),
-  m_log("Node")
+  // fill histograms with one cached event (N > 0 fixes the number of histograms at compile time)
+  template <unsigned int N>
+  inline void FillHists(Node::Hist * hists, unsigned int nHists, const EventCache * cache, long ievent, float weight)
+  {
+    const unsigned int n = N > 0 ? N : nHists;
+    for (unsigned int ihist = 0; ihist < n; ++ihist) {
+      hists[ihist].Fill(cache->Bin(hists[ihist].GetVariable()->Index(), ievent), weight);
+    }
+  }
+
+  // fill buffer laid out like the histograms with one cached event (N > 0 fixes the number of histograms at compile time)
+  template <unsigned int N>
+  inline void FillHistBuffer(const Node::Hist * hists, unsigned int nHists, const EventCache * cache, long ievent, float weight, double * sumw, double * sumw2)
+  {
+    const unsigned int n = N > 0 ? N : nHists;
+    for (unsigned int ihist = 0; ihist < n; ++ihist) {
+      unsigned int bin = cache->Bin(hists[ihist].GetVariable()->Index(), ievent);
+      sumw [bin] += weight;
+      sumw2[bin] += weight*weight;
+      sumw  += hists[ihist].Ncells();
+      sumw2 += hists[ihist].Ncells();
+    }
+  }
+
+}
+
+
+
+Node::Summary::Summary(const double * values) :
+  m_variable(Variables::Get().at(static_cast<unsigned int>(values[1]))),
+  m_position(values[0]),
+  m_cutValue(values[2]),
+  m_cutBin(values[3]),
+  m_chisquare(values[4]),
+  m_sumSourceLow(values[5]),
+  m_sumTargetLow(values[6]),
+  m_sumSourceHigh(values[7]),
+  m_sumTargetHigh(values[8]),
+  m_sumSource(values[9]),
+  m_sumTarget(values[10])
 {
+}
 
-  // set this node as output node of input branch, and get sum of events from input branch
-  if ( input ) {
 
-    input->SetOutputNode(this);
-    m_sumSource = input->SumSource();
-    m_sumTarget = input->SumTarget();
+void Node::Summary::Pack(double * values) const
+{
 
-    // set to FINAL if there are fewer than twice the min number of events on the node since then it can't be split
-    // (there still exist other cases where it can't be split, but we have to fill the histograms to identify these...)
-    int minEvents = 0;
-    Config::Instance().getif<int>("MinEventsNode", minEvents);
-    if ( m_sumTarget < 2.*minEvents || m_sumSource < 2.*minEvents) {
-      m_status = FINAL;
-    }
+  // same order as the constructor from flat form (all values are exact as doubles)
+  values[0]  = m_position;
+  values[1]  = m_variable->Index();
+  values[2]  = m_cutValue;
+  values[3]  = m_cutBin;
+  values[4]  = m_chisquare;
+  values[5]  = m_sumSourceLow;
+  values[6]  = m_sumTargetLow;
+  values[7]  = m_sumSourceHigh;
+  values[8]  = m_sumTargetHigh;
+  values[9]  = m_sumSource;
+  values[10] = m_sumTarget;
 
-  }
+}
+
+
+const std::string & Node::Summary::Name() const
+{
+
+  return m_variable->Name();
+
+}
+
+
+Node::Settings::Settings() :
+  m_minEvents(0),
+  m_doFeatSampling(false),
+  m_featSamplingFraction(1),
+  m_splitMode(NONE),
+  m_log("Node")
+{
+
+  // get min events required to form a node
+  Config::Instance().getif<int>("MinEventsNode", m_minEvents);
 
   // set method depending switches 
-  static const std::string & methodStr = Config::Instance().get<std::string>("Method");
-  Method::TYPE method = Method::Type( methodStr );
+  Method::TYPE method = Method::Type( Config::Instance().get<std::string>("Method") );
   // feature sampling
   if (method == Method::RF || method == Method::ET) {
     m_doFeatSampling = true;
+    Config::Instance().getif<float>("FeatureSamplingFraction", m_featSamplingFraction);
   }
   // split mode
   if (method == Method::ET) {
@@ -77,26 +135,53 @@ Node::Node(Branch * input) :
 }
 
 
-Node::~Node()
+Node::Node(Branch * input, const Settings & settings) :
+  m_status(NEW),
+  m_id(1),
+  m_input(input),
+  m_output1(0),
+  m_output2(0),
+  m_weight(0.),
+  m_weightIsSet(false),
+  m_histSetSource(),
+  m_histSetTarget(),
+  m_positions(),
+  m_nVariables(0),
+  m_sumSource(-1),
+  m_sumTarget(-1),
+  m_settings(settings),
+  m_log(settings.GetLog())
 {
 
-  delete m_input;
-  m_input = 0;
+  // set this node as output node of input branch, and get sum of events from input branch
+  if ( input ) {
 
-  for (unsigned int i = 0; i < m_histSetSource.size(); ++i) {
-    delete m_histSetSource.at(i);
-    m_histSetSource.at(i) = 0;
-  }
+    input->SetOutputNode(this);
+    if ( input->InputNode() ) m_id = 2*input->InputNode()->Id() + (input->IsGreater() ? 1 : 0);
+    m_sumSource = input->SumSource();
+    m_sumTarget = input->SumTarget();
+
+    // set to FINAL if there are fewer than twice the min number of events on the node since then it can't be split
+    // (there still exist other cases where it can't be split, but we have to fill the histograms to identify these...)
+    int minEvents = m_settings.MinEvents();
+    if ( m_sumTarget < 2.*minEvents || m_sumSource < 2.*minEvents) {
+      m_status = FINAL;
+    }
 
-  for (unsigned int i = 0; i < m_histSetTarget.size(); ++i) {
-    delete m_histSetTarget.at(i);
-    m_histSetTarget.at(i) = 0;
   }
 
 }
 
 
-void Node::Initialize(const HistDefs * histDefs)
+Node::~Node()
+{
+
+  // input branch is owned by the decision tree
+  
+}
+
+
+void Node::Initialize(Context & context)
 {
 
   // check if this node was already initialized
@@ -106,17 +191,15 @@ void Node::Initialize(const HistDefs * histDefs)
   }
   
   // get variables used for splitting the tree
-  const std::vector<HistDefs::Entry> & histDefEntries = histDefs->GetEntries();
+  const std::vector<HistDefs::Entry> & histDefEntries = context.GetHistDefs()->GetEntries();
   std::vector<unsigned int> indices;
-  if ( m_doFeatSampling ) {
+  if ( m_settings.DoFeatSampling() ) {
     
     // Random Forest and ExtraTrees use "feature sampling", only using random subset of the variables to grow the decision tree
-    static int samplingFractionSeed = Config::Instance().get<float>("SamplingFractionSeed");
-    static float featSamplingFraction = Config::Instance().get<float>("FeatureSamplingFraction");
-    static TRandom3 ran( samplingFractionSeed );
+    Philox random = context.Stream(m_id, Philox::FEATURE_SAMPLING);
     for (unsigned int index = 0; index < histDefEntries.size(); ++index) indices.push_back( index );
-    for (unsigned int index = 0; index < histDefEntries.size(); ++index) std::swap(indices[ index ], indices[static_cast<int>(ran.Rndm()*(static_cast<float>(indices.size()) - std::numeric_limits<float>::epsilon()))] );
-    indices.resize(featSamplingFraction*histDefEntries.size());
+    for (unsigned int index = 0; index < histDefEntries.size(); ++index) std::swap(indices[ index ], indices[static_cast<int>(random.Rndm()*(static_cast<float>(indices.size()) - std::numeric_limits<float>::epsilon()))] );
+    indices.resize(m_settings.FeatSamplingFraction()*histDefEntries.size());
     
   }
   else {
@@ -134,33 +217,41 @@ void Node::Initialize(const HistDefs * histDefs)
     throw(0);
   }
   
-  // declare target and initial histograms for each variable
-  for (unsigned int index : indices) {
-    const HistDefs::Entry & histDef = histDefEntries.at(index);
-    m_histSetSource.push_back( new Hist(histDef) );
-    m_histSetTarget.push_back( new Hist(histDef) ); 
+  // declare target and initial histograms for each variable (in feature-parallel mode, only for the variables of this process)
+  m_nVariables = indices.size();
+  for (unsigned int position = 0; position < indices.size(); ++position) {
+    const HistDefs::Entry & histDef = histDefEntries.at(indices[position]);
+    if ( ! Communicator::Instance().OwnsVariable(histDef.GetVariable()->Index()) ) continue;
+    m_histSetSource.push_back( Hist(histDef) );
+    m_histSetTarget.push_back( Hist(histDef) ); 
+    m_positions.push_back( position );
   }
   
   
 }
 
 
-void Node::Build(Branch *& b1, Branch *& b2)
+Node::Summary * Node::Split(Context & context)
 {
 
   // get node split
-  Summary * nodeSummary = 0;
-  if ( m_splitMode == RANDOM ) {
-    nodeSummary = SplitRandom();
-  }
-  else if ( m_splitMode == CHISQUARE ) {
-    nodeSummary = SplitChisquare();
+  if ( m_settings.SplitMode() == RANDOM ) {
+    Philox random = context.Stream(m_id, Philox::RANDOM_SPLIT);
+    return SplitRandom(random);
   }
-  else {
-    m_log << Log::ERROR << "Couldn't optimize node splitting - no split function was chosen!" << Log::endl();
-    throw(0);
+  else if ( m_settings.SplitMode() == CHISQUARE ) {
+    return SplitChisquare();
   }
-				   
+
+  m_log << Log::ERROR << "Couldn't optimize node splitting - no split function was chosen!" << Log::endl();
+  throw(0);
+
+}
+
+
+void Node::Build(Branch *& b1, Branch *& b2, std::deque<Branch> & branches, Summary * nodeSummary)
+{
+
   // sanity check
   if ( m_input == 0 && nodeSummary == 0 ) {
     m_log << Log::ERROR << "Build() : This is the first node in the tree (input branch is null), but there is no node summary - we can't build the friggin tree?!?!" << Log::endl();
@@ -173,8 +264,8 @@ void Node::Build(Branch *& b1, Branch *& b2)
   }
   else if ( m_input == 0 ) {
     m_status = FIRST;
-    m_sumTarget = nodeSummary->TargetHist()->ROOTHist()->Integral(0, -1);
-    m_sumSource = nodeSummary->SourceHist()->ROOTHist()->Integral(0, -1);
+    m_sumTarget = nodeSummary->SumTarget();
+    m_sumSource = nodeSummary->SumSource();
   } 
   else {
     m_status = INTERMEDIATE;
@@ -186,8 +277,10 @@ void Node::Build(Branch *& b1, Branch *& b2)
     b2 = 0;
   }
   else {
-    b1 = new Branch(this, nodeSummary->Name(), nodeSummary->CutValue(), false, nodeSummary->SumSourceLow() , nodeSummary->SumTargetLow() );
-    b2 = new Branch(this, nodeSummary->Name(), nodeSummary->CutValue(), true , nodeSummary->SumSourceHigh(), nodeSummary->SumTargetHigh());
+    branches.emplace_back(this, nodeSummary->GetVariable(), nodeSummary->CutValue(), false, nodeSummary->SumSourceLow() , nodeSummary->SumTargetLow() , nodeSummary->CutBin());
+    b1 = &branches.back();
+    branches.emplace_back(this, nodeSummary->GetVariable(), nodeSummary->CutValue(), true , nodeSummary->SumSourceHigh(), nodeSummary->SumTargetHigh(), nodeSummary->CutBin());
+    b2 = &branches.back();
   }
 
   // set output branches for this node
@@ -197,16 +290,8 @@ void Node::Build(Branch *& b1, Branch *& b2)
   // print info
   Print("Build() : ", Log::VERBOSE);
   
-  // clean up
+  // clean up (histograms are kept, since they may be needed to get the histograms of the output nodes)
   delete nodeSummary;
-  for (Hist * hist : m_histSetSource) {
-    delete hist;
-    hist = 0;
-  }
-  for (Hist * hist : m_histSetTarget) {
-    delete hist;
-    hist = 0;
-  }
   
 }
 
@@ -217,76 +302,57 @@ Node::Summary * Node::SplitChisquare()
   // declare NodeSummary
   Summary * nodeSummary = 0;
   
-  // get number of histograms
+  // get number of histograms (in feature-parallel mode, this process may have none)
   int nhist = m_histSetSource.size();
-  if ( nhist == 0 ) {
+  if ( m_nVariables == 0 ) {
     m_log << Log::ERROR << "SplitChisquare() : No histograms!" << Log::endl();
     throw(0);
   }
   
-  // get min events required to form a node
-  static int minEvents = Config::Instance().get<int>("MinEventsNode");
-  
   // calculate cut-values and chisquares
+  std::vector<float> chisquares;
   for (int i = 0; i < nhist; ++i) {
     
-    Hist * histTarg = m_histSetTarget.at(i);
-    Hist * histSour = m_histSetSource.at(i);
+    const Hist * histTarg = &m_histSetTarget.at(i);
+    const Hist * histSour = &m_histSetSource.at(i);
     
-    const TH1F * rootHistTarg = histTarg->ROOTHist();
-    const TH1F * rootHistSour = histSour->ROOTHist();
+    // get integrals below/above each bin, and chisquare of each cut
+    Integrals integralsTarg(histTarg);
+    Integrals integralsSour(histSour);
+    ScanCuts(integralsSour, integralsTarg, chisquares);
     
-    m_log << Log::DEBUG << "SplitChisquare() : targ integral = " << rootHistTarg->Integral(0,-1) << "  sour integral = " << rootHistSour->Integral(0,-1) << Log::endl();
+    m_log << Log::DEBUG << "SplitChisquare() : targ integral = " << integralsTarg.Low(integralsTarg.Ncells() - 1) << "  sour integral = " << integralsSour.Low(integralsSour.Ncells() - 1) << Log::endl();
     
+    // find best cut (the last bin is not considered, since only the overflow bin would be above the cut)
     float maxChisquare = 0;
-    float cutValue = std::numeric_limits<float>::max();
-    float sumTargetLow  = 0;
-    float sumTargetHigh = 0;
-    float sumSourceLow  = 0;
-    float sumSourceHigh = 0;
-    
-    // loop over bins in histogram
-    for (int xbin = 1; xbin < rootHistTarg->GetNbinsX(); ++xbin) {
-      
-      // get integrals above and below
-      Double_t sumSourLowErr  = 0;
-      Double_t sumTargLowErr  = 0;
-      Double_t sumSourHighErr = 0;
-      Double_t sumTargHighErr = 0;
-      Double_t sumSourLow  = rootHistSour->IntegralAndError(0       , xbin, sumSourLowErr );
-      Double_t sumTargLow  = rootHistTarg->IntegralAndError(0       , xbin, sumTargLowErr );
-      Double_t sumSourHigh = rootHistSour->IntegralAndError(xbin + 1, -1  , sumSourHighErr);
-      Double_t sumTargHigh = rootHistTarg->IntegralAndError(xbin + 1, -1  , sumTargHighErr);
-      
-      m_log << Log::DEBUG << "SplitChisquare() : sumSourLow = " << sumSourLow << "  sumTargLow = " << sumTargLow << "  sumSourHigh = " << sumSourHigh << "  sumTargHigh = " << sumTargHigh << Log::endl();
-      
-      // check min events on potential sub-nodes
-      if (sumSourLow < minEvents || sumSourHigh < minEvents || sumTargLow < minEvents || sumTargHigh < minEvents ) continue;
-      
-      // calculate chisquare and update best candidate
-      float chisquare = pow(sumSourLow - sumTargLow, 2)/(pow(sumSourLowErr, 2) + pow(sumTargLowErr, 2)) + pow(sumSourHigh - sumTargHigh, 2)/(pow(sumSourHighErr, 2) + pow(sumTargHighErr, 2));
-      if (chisquare > maxChisquare) {
-	maxChisquare  = chisquare;
-	cutValue      = rootHistTarg->GetBinLowEdge(xbin + 1);
-	sumSourceLow  = sumSourLow;
-	sumSourceHigh = sumSourHigh;
-	sumTargetLow  = sumTargLow;
-	sumTargetHigh = sumTargHigh;
+    int maxBin = -1;
+    int nbins = histTarg->Ncells() - 2;
+    for (int xbin = 1; xbin < nbins; ++xbin) {
+      if (chisquares[xbin] > maxChisquare) {
+	maxChisquare = chisquares[xbin];
+	maxBin       = xbin;
       }
-      
     }
     
-    m_log << Log::DEBUG << "SplitChisquare() : sumSourceLow = " << sumSourceLow << "  sumTargetLow = " << sumTargetLow << "  sumSourceHigh = " << sumSourceHigh << "  sumTargetHigh = " << sumTargetHigh << Log::endl();
-    
     // store info for this variable
     if (maxChisquare > 0) {
+
+      float cutValue      = histTarg->BinLowEdge(maxBin + 1);
+      float sumSourceLow  = integralsSour.Low (maxBin);
+      float sumSourceHigh = integralsSour.High(maxBin);
+      float sumTargetLow  = integralsTarg.Low (maxBin);
+      float sumTargetHigh = integralsTarg.High(maxBin);
+
+      m_log << Log::DEBUG << "SplitChisquare() : sumSourceLow = " << sumSourceLow << "  sumTargetLow = " << sumTargetLow << "  sumSourceHigh = " << sumSourceHigh << "  sumTargetHigh = " << sumTargetHigh << Log::endl();
+
       if ( ! nodeSummary ) {
-	nodeSummary = new Summary(histSour, histTarg, cutValue, maxChisquare, sumSourceLow, sumTargetLow, sumSourceHigh, sumTargetHigh);
+	nodeSummary = new Summary(histSour, histTarg, m_positions[i], cutValue, maxBin + 1, maxChisquare, sumSourceLow, sumTargetLow, sumSourceHigh, sumTargetHigh);
       }
       else if ( maxChisquare > nodeSummary->Chisquare() ) {
 	delete nodeSummary;
-	nodeSummary = new Summary(histSour, histTarg, cutValue, maxChisquare, sumSourceLow, sumTargetLow, sumSourceHigh, sumTargetHigh);
+	nodeSummary = new Summary(histSour, histTarg, m_positions[i], cutValue, maxBin + 1, maxChisquare, sumSourceLow, sumTargetLow, sumSourceHigh, sumTargetHigh);
       }
+
     }
     
   }
@@ -297,77 +363,51 @@ Node::Summary * Node::SplitChisquare()
 }
  
 
-Node::Summary * Node::SplitRandom()
+Node::Summary * Node::SplitRandom(Philox & random)
 {
 
   // declare NodeSummary
   Summary * nodeSummary = 0;
 
-  // get number of histograms
-  int nhist = m_histSetSource.size();
-  if ( nhist == 0 ) {
+  // get number of variables
+  if ( m_nVariables == 0 ) {
     m_log << Log::ERROR << "SplitRandom() : No histograms!" << Log::endl();
     throw(0);
   }
   
-  // get min events required to form a node
-  static int minEvents = Config::Instance().get<int>("MinEventsNode");
-
-  // randomly chose variable
-  static int samplingFractionSeed = Config::Instance().get<float>("SamplingFractionSeed");
-  static TRandom3 ran( samplingFractionSeed );
-  unsigned int ranIndex = static_cast<unsigned int>(ran.Rndm()*(static_cast<float>(nhist) - std::numeric_limits<float>::epsilon()));
-
-  // get ROOT histograms
-  Hist * histTarg = m_histSetTarget.at( ranIndex );
-  Hist * histSour = m_histSetSource.at( ranIndex );
-  const TH1F * rootHistTarg = histTarg->ROOTHist();
-  const TH1F * rootHistSour = histSour->ROOTHist();
-
-  // identify valid cut values
+  // randomly chose variable (in feature-parallel mode, only the process of that variable has its histograms)
+  unsigned int ranIndex = static_cast<unsigned int>(random.Rndm()*(static_cast<float>(m_nVariables) - std::numeric_limits<float>::epsilon()));
+  std::vector<unsigned int>::const_iterator itr = std::find(m_positions.begin(), m_positions.end(), ranIndex);
+  if ( itr == m_positions.end() ) return 0;
+  unsigned int ihist = itr - m_positions.begin();
+
+  // get histograms, integrals below/above each bin, and chisquare of each cut
+  const Hist * histTarg = &m_histSetTarget.at( ihist );
+  const Hist * histSour = &m_histSetSource.at( ihist );
+  Integrals integralsTarg(histTarg);
+  Integrals integralsSour(histSour);
+  std::vector<float> chisquares;
+  ScanCuts(integralsSour, integralsTarg, chisquares);
+
+  // identify valid cut values (both source and target distributions have enough events below/above the cut)
   std::vector<int> xbins;
-  for (int xbin = 1; xbin <= rootHistSour->GetNbinsX(); ++xbin) {
-
-    // get event counts below/above potential cut
-    Double_t sumSourLowErr  = 0;
-    Double_t sumTargLowErr  = 0;
-    Double_t sumSourHighErr = 0;
-    Double_t sumTargHighErr = 0;
-    Double_t sumSourLow  = rootHistSour->IntegralAndError(0       , xbin, sumSourLowErr );
-    Double_t sumTargLow  = rootHistTarg->IntegralAndError(0       , xbin, sumTargLowErr );
-    Double_t sumSourHigh = rootHistSour->IntegralAndError(xbin + 1, -1  , sumSourHighErr);
-    Double_t sumTargHigh = rootHistTarg->IntegralAndError(xbin + 1, -1  , sumTargHighErr);
-
-    // check if both source and target distributions have enough events below/above the cuts
-    if (sumSourLow >= minEvents && sumSourHigh >= minEvents && sumTargLow >= minEvents && sumTargHigh >= minEvents ) {
-      xbins.push_back( xbin );
-    }
-    
+  int nbins = histSour->Ncells() - 2;
+  for (int xbin = 1; xbin <= nbins; ++xbin) {
+    if ( ! (chisquares[xbin] < 0) ) xbins.push_back( xbin );
   }
 
   // if any valid cuts, then randomly pick one
   if ( xbins.size() > 0 ) {
 
     // get random cut (among valid cuts) 
-    int index = static_cast<int>(ran.Rndm()*(static_cast<float>(xbins.size()) - std::numeric_limits<float>::epsilon()));
+    int index = static_cast<int>(random.Rndm()*(static_cast<float>(xbins.size()) - std::numeric_limits<float>::epsilon()));
     int xbin = xbins.at(index);
 
-    // get event counts below/above cut
-    Double_t sumSourLowErr  = 0;
-    Double_t sumTargLowErr  = 0;
-    Double_t sumSourHighErr = 0;
-    Double_t sumTargHighErr = 0;
-    Double_t sumSourLow  = rootHistSour->IntegralAndError(0       , xbin, sumSourLowErr );
-    Double_t sumTargLow  = rootHistTarg->IntegralAndError(0       , xbin, sumTargLowErr );
-    Double_t sumSourHigh = rootHistSour->IntegralAndError(xbin + 1, -1  , sumSourHighErr);
-    Double_t sumTargHigh = rootHistTarg->IntegralAndError(xbin + 1, -1  , sumTargHighErr);
-
-    // calculate chisquare and get cut value
-    float chisquare = pow(sumSourLow - sumTargLow, 2)/(pow(sumSourLowErr, 2) + pow(sumTargLowErr, 2)) + pow(sumSourHigh - sumTargHigh, 2)/(pow(sumSourHighErr, 2) + pow(sumTargHighErr, 2));
-    float cutValue  = rootHistTarg->GetBinLowEdge(xbin + 1);
+    // get cut value
+    float cutValue  = histTarg->BinLowEdge(xbin + 1);
     
     // set node summary
-    nodeSummary = new Summary(histSour, histTarg, cutValue, chisquare, sumSourLow, sumTargLow, sumSourHigh, sumTargHigh);
+    nodeSummary = new Summary(histSour, histTarg, ranIndex, cutValue, xbin + 1, chisquares[xbin], integralsSour.Low(xbin), integralsTarg.Low(xbin), integralsSour.High(xbin), integralsTarg.High(xbin));
     
   } 
  
@@ -380,6 +420,28 @@ Node::Summary * Node::SplitRandom()
 }
 
 
+void Node::ScanCuts(const Integrals & source, const Integrals & target, std::vector<float> & chisquares) const
+{
+
+  // get min events required to form a node
+  int minEvents = m_settings.MinEvents();
+
+  // chisquare of cut above each bin, in one sweep over the cumulative sums (-1 if there are too few events on either side of the cut)
+  int ncells = source.Ncells();
+  chisquares.resize(ncells);
+  for (int xbin = 0; xbin < ncells; ++xbin) {
+    double sumSourLow  = source.Low (xbin);
+    double sumTargLow  = target.Low (xbin);
+    double sumSourHigh = source.High(xbin);
+    double sumTargHigh = target.High(xbin);
+    bool valid = sumSourLow >= minEvents && sumSourHigh >= minEvents && sumTargLow >= minEvents && sumTargHigh >= minEvents;
+    float chisquare = (sumSourLow - sumTargLow)*(sumSourLow - sumTargLow)/(source.LowErr2(xbin) + target.LowErr2(xbin)) + (sumSourHigh - sumTargHigh)*(sumSourHigh - sumTargHigh)/(source.HighErr2(xbin) + target.HighErr2(xbin));
+    chisquares[xbin] = valid ? chisquare : -1;
+  }
+
+}
+
+
 void Node::Print(const std::string & prefix, Log::LEVEL level) const
 {
 
@@ -390,18 +452,9 @@ void Node::Print(const std::string & prefix, Log::LEVEL level) const
   m_log << level << prefix << "Cuts        : ";
   const Branch * b = InputBranch();
   while ( b ) {
-    // get cut object
-    const Branch::Cut * cut = b->CutObject();
-    const Branch::Smaller * lt = dynamic_cast<const Branch::Smaller *>(cut);
-    const Branch::Greater * gt = dynamic_cast<const Branch::Greater *>(cut);    
-    // check if valid
-    if ( (lt && gt) || (!lt && !gt) ) {
-      m_log << Log::endl();
-      m_log << Log::ERROR << "Couldn't determine if greater or smaller!" << Log::endl();
-      throw(0);
-    }
     // print cut
-    m_log << cut->GetVariable()->Name() << (lt ? "<" : ">") << cut->CutValue() << "|";
+    const Branch::Cut & cut = b->CutObject();
+    m_log << cut.GetVariable()->Name() << (cut.IsGreater() ? ">" : "<") << cut.CutValue() << "|";
     // update branch
     b = b->InputNode()->InputBranch();
   }
@@ -435,11 +488,26 @@ const Branch * Node::InputBranch() const
 }
 
 
-const Branch * Node::OutputBranch() const
+const Branch * Node::OutputBranch(const float * features) const
 {
 
-  if      ( m_output1 && m_output1->Pass() ) return m_output1;
-  else if ( m_output2 && m_output2->Pass() ) return m_output2;
+  if      ( m_output1 && m_output1->Pass(features) ) return m_output1;
+  else if ( m_output2 && m_output2->Pass(features) ) return m_output2;
+  else if ( m_output1 && m_output2 ) {
+    m_log << Log::ERROR << "OutputBranch() : Output branches are not both null, but the event doesn't pass one of them!" << Log::endl();
+    throw(0);
+  }
+  
+  return nullptr;
+
+}
+
+
+const Branch * Node::OutputBranch(const EventCache * cache, long ievent) const
+{
+
+  if      ( m_output1 && m_output1->Pass(cache, ievent) ) return m_output1;
+  else if ( m_output2 && m_output2->Pass(cache, ievent) ) return m_output2;
   else if ( m_output1 && m_output2 ) {
     m_log << Log::ERROR << "OutputBranch() : Output branches are not both null, but the event doesn't pass one of them!" << Log::endl();
     throw(0);
@@ -468,24 +536,148 @@ void Node::SetOutputBranch(const Branch * branch, bool isGreater)
 }
 
 
-void Node::FillSource(float weight)
+void Node::FillSource(const EventCache * cache, long ievent, float weight)
+{
+
+  // fill histograms (the loop is unrolled when all variables are used)
+  if ( m_histSetSource.size() == Schema::NVARIABLES ) FillHists<Schema::NVARIABLES>(m_histSetSource.data(), Schema::NVARIABLES, cache, ievent, weight);
+  else FillHists<0>(m_histSetSource.data(), m_histSetSource.size(), cache, ievent, weight);
+
+}
+
+
+void Node::FillTarget(const EventCache * cache, long ievent, float weight)
+{
+
+  // fill histograms (the loop is unrolled when all variables are used)
+  if ( m_histSetTarget.size() == Schema::NVARIABLES ) FillHists<Schema::NVARIABLES>(m_histSetTarget.data(), Schema::NVARIABLES, cache, ievent, weight);
+  else FillHists<0>(m_histSetTarget.data(), m_histSetTarget.size(), cache, ievent, weight);
+
+}
+
+
+unsigned int Node::BufferSize() const
+{
+
+  // source and target histograms have the same layout
+  unsigned int size = 0;
+  for (const Hist & hist : m_histSetSource) {
+    size += hist.Ncells();
+  }
+  return size;
+
+}
+
+
+void Node::FillBuffer(const EventCache * cache, long ievent, float weight, double * sumw, double * sumw2) const
+{
+
+  // fill buffer (one block of bins per histogram, the loop is unrolled when all variables are used)
+  if ( m_histSetSource.size() == Schema::NVARIABLES ) FillHistBuffer<Schema::NVARIABLES>(m_histSetSource.data(), Schema::NVARIABLES, cache, ievent, weight, sumw, sumw2);
+  else FillHistBuffer<0>(m_histSetSource.data(), m_histSetSource.size(), cache, ievent, weight, sumw, sumw2);
+
+}
+
+
+void Node::AddSource(const double * sumw, const double * sumw2)
+{
+
+  // add buffer to histograms
+  for (Hist & hist : m_histSetSource) {
+    hist.Add(sumw, sumw2);
+    sumw  += hist.Ncells();
+    sumw2 += hist.Ncells();
+  }
+
+}
+
+
+void Node::AddTarget(const double * sumw, const double * sumw2)
+{
+
+  // add buffer to histograms
+  for (Hist & hist : m_histSetTarget) {
+    hist.Add(sumw, sumw2);
+    sumw  += hist.Ncells();
+    sumw2 += hist.Ncells();
+  }
+
+}
+
+
+unsigned int Node::HistBufferSize() const
+{
+
+  // sums of weights and squared weights for source and target histograms
+  return 4*BufferSize();
+
+}
+
+
+void Node::SetHistBuffer(double * buffer)
+{
+
+  for (Hist & hist : m_histSetSource) {
+    hist.SetBuffer(buffer);
+    buffer += 2*hist.Ncells();
+  }
+  for (Hist & hist : m_histSetTarget) {
+    hist.SetBuffer(buffer);
+    buffer += 2*hist.Ncells();
+  }
+
+}
+
+
+bool Node::HasHists(const Node * node) const
+{
+
+  // source and target histograms have the same variables
+  for (const Hist & hist : node->m_histSetSource) {
+    if ( ! FindHist(m_histSetSource, hist.GetVariable()) ) return false;
+  }
+  return true;
+  
+}
+
+
+void Node::Subtract(const Node * parent, const Node * sibling)
 {
 
-  // fill histograms
-  for (Hist * hist : m_histSetSource) {
-    hist->Fill(weight);
+  // parent and sibling need histograms for all variables of this node
+  if ( ! parent->HasHists(this) || ! sibling->HasHists(this) ) {
+    m_log << Log::ERROR << "Subtract() : Parent or sibling node doesn't have histograms for all variables!" << Log::endl();
+    throw(0);
+  }
+
+  // subtract histograms
+  for (Hist & hist : m_histSetSource) {
+    hist.Subtract(FindHist(parent->m_histSetSource, hist.GetVariable()), FindHist(sibling->m_histSetSource, hist.GetVariable()));
+  }
+  for (Hist & hist : m_histSetTarget) {
+    hist.Subtract(FindHist(parent->m_histSetTarget, hist.GetVariable()), FindHist(sibling->m_histSetTarget, hist.GetVariable()));
   }
 
 }
 
 
-void Node::FillTarget(float weight)
+void Node::ClearHists()
+{
+
+  m_histSetSource.clear();
+  m_histSetTarget.clear();
+  m_positions.clear();
+
+}
+
+
+const Node::Hist * Node::FindHist(const std::vector<Hist> & histSet, const Variable * variable) const
 {
 
-  // fill histograms
-  for (Hist * hist : m_histSetTarget) {
-    hist->Fill(weight);
+  for (const Hist & hist : histSet) {
+    if ( hist.GetVariable() == variable ) return &hist;
   }
+  return 0;
 
 }
 
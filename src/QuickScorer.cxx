@@ -0,0 +1,122 @@
+// local includes
+#include "QuickScorer.h"
+#include "DecisionTree.h"
+#include "Variables.h"
+#include "Config.h"
+
+// stl includes
+#include <algorithm>
+
+
+
+bool QuickScorer::Supports(const std::vector<const DecisionTree *> & trees)
+{
+
+  if ( trees.empty() ) return false;
+  for (const DecisionTree * tree : trees) {
+    if ( tree->NumberOfFlatWeights() > MAXLEAVES ) return false;
+  }
+  return true;
+
+}
+
+
+QuickScorer::QuickScorer(const std::vector<const DecisionTree *> & trees) :
+  m_nTrees(trees.size()),
+  m_cuts(),
+  m_first(),
+  m_leafWeights(trees.size()*MAXLEAVES, 0),
+  m_log("QuickScorer")
+{
+
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+  // check trees
+  if ( ! Supports(trees) ) {
+    m_log << Log::ERROR << "QuickScorer() : Trees with more than " << MAXLEAVES << " final nodes can't be evaluated" << Log::endl();
+    throw(0);
+  }
+
+  // collect the cuts and final nodes of all trees
+  for (unsigned int itree = 0; itree < m_nTrees; ++itree) {
+    AddNode(trees[itree], itree, trees[itree]->NumberOfFlatNodes() > 0 ? 0 : ~0, 0);
+  }
+
+  // sort cuts by variable and cut value
+  std::stable_sort(m_cuts.begin(), m_cuts.end(), [](const Cut & c1, const Cut & c2) {
+      return c1.variable < c2.variable || (c1.variable == c2.variable && c1.cutValue < c2.cutValue);
+    });
+  unsigned int nVariables = Variables::Get().size();
+  m_first.assign(nVariables + 1, m_cuts.size());
+  for (unsigned int icut = m_cuts.size(); icut-- > 0; ) {
+    m_first[m_cuts[icut].variable] = icut;
+  }
+  for (unsigned int ivar = nVariables; ivar-- > 0; ) {
+    m_first[ivar] = std::min(m_first[ivar], m_first[ivar + 1]);
+  }
+  m_log << Log::DEBUG << "QuickScorer() : " << m_nTrees << " trees with " << m_cuts.size() << " cuts" << Log::endl();
+
+}
+
+
+unsigned int QuickScorer::AddNode(const DecisionTree * tree, unsigned int itree, int inode, unsigned int firstLeaf)
+{
+
+  // final node : store weight (final nodes are numbered from left to right)
+  if ( inode < 0 ) {
+    m_leafWeights[itree*MAXLEAVES + firstLeaf] = tree->FlatWeights()[~inode];
+    return 1;
+  }
+
+  // add output nodes
+  const DecisionTree::FlatNode & node = tree->FlatNodes()[inode];
+  unsigned int nLow  = AddNode(tree, itree, node.output[0], firstLeaf);
+  unsigned int nHigh = AddNode(tree, itree, node.output[1], firstLeaf + nLow);
+
+  // events at or above the cut can't end up in the final nodes below the cut
+  Cut cut;
+  cut.variable = node.variable;
+  cut.cutValue = node.cutValue;
+  cut.tree     = itree;
+  cut.mask     = ~( ((nLow == 64 ? 0 : (uint64_t(1) << nLow)) - 1) << firstLeaf );
+  m_cuts.push_back( cut );
+
+  return nLow + nHigh;
+
+}
+
+
+void QuickScorer::GetTreeWeights(const float * features, unsigned int nVariables, int nEvents, float * treeWeights) const
+{
+
+  // one mask of remaining final nodes per tree (scratch space of the calling thread)
+  static thread_local std::vector<uint64_t> masks;
+  masks.resize(m_nTrees);
+
+  for (int ievent = 0; ievent < nEvents; ++ievent) {
+    const float * event = features + ievent*nVariables;
+
+    // clear the final nodes below each passed cut (cuts are sorted, so the scan stops at the first cut not passed)
+    std::fill(masks.begin(), masks.end(), ~uint64_t(0));
+    for (unsigned int ivar = 0; ivar < nVariables; ++ivar) {
+      float value = event[ivar];
+      for (unsigned int icut = m_first[ivar]; icut < m_first[ivar + 1]; ++icut) {
+	const Cut & cut = m_cuts[icut];
+	if ( ! (value >= cut.cutValue) ) break;
+	masks[cut.tree] &= cut.mask;
+      }
+    }
+
+    // get weight of the leftmost remaining final node
+    for (unsigned int itree = 0; itree < m_nTrees; ++itree) {
+      treeWeights[itree*nEvents + ievent] = m_leafWeights[itree*MAXLEAVES + __builtin_ctzll(masks[itree])];
+    }
+  }
+
+}
@@ -4,13 +4,18 @@
 #include "DecisionTree.h"
 #include "Config.h"
 #include "HistDefs.h"
-#include "HistService.h"
+#include "EventCache.h"
+#include "Context.h"
 #include "Variables.h"
 #include "Variable.h"
 #include "Event.h"
+#include "Communicator.h"
 
 // stl includes
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
 
 // ROOT includes
 #include "TTree.h"
@@ -64,18 +69,23 @@ void RandomForest::Initialize()
 {
 
   // check if bagging is enabled
-  static bool bagging = false;
+  bool bagging = false;
   Config::Instance().getif<bool>("Bagging", bagging); 
   if ( ! bagging ) {
     m_log << Log::ERROR << "Initialize() : Bagging needs to be enabled. In config file : 'bool bagging = true'" << Log::endl();
     throw(0);    
   }
+
+  // read source and target events into memory
+  Algorithm::FillCache();
   
   // get histogram definitions
   m_histDefs = new HistDefs;
   m_histDefs->Initialize();
-  m_histDefs->UpdateVariableRanges(m_target);
-  m_histDefs->UpdateVariableRanges(m_source);
+  m_histDefs->UpdateVariableRanges(m_cacheTarget);
+  m_histDefs->UpdateVariableRanges(m_cacheSource);
+  m_cacheTarget->Quantize(m_histDefs);
+  m_cacheSource->Quantize(m_histDefs);
   for (const HistDefs::Entry & entry : m_histDefs->GetEntries()) {
     m_log << Log::INFO << "Initialize() : Histogram name : " << entry.Name() << ", range = ( " << entry.Xmin() << " , " << entry.Xmax() << " )" << Log::endl();
   }
@@ -91,50 +101,93 @@ void RandomForest::Process()
   
   // grow decision trees
   int ntree = Config::Instance().get<int>("NumberOfTrees");
-  for (int itree = 0; itree < ntree; ++itree) {
+  Algorithm::GrowForest(forest, ntree, m_histDefs);
+  
+  // add forest to internal vector
+  m_forests.clear();
+  m_forests.push_back( forest );
+  
+}
 
-    // bagging (prepare event indices)
-    Algorithm::PrepareIndices();
-    
-    // create tree
-    DecisionTree * dtree = new DecisionTree(m_source, m_target, m_indicesSource, m_indicesTarget, m_histDefs);
-    dtree->GrowTree();
+
+DecisionTree * RandomForest::GrowTree(Context & context, int nThreads)
+{
+
+  // bagging (prepare event indices)
+  Algorithm::PrepareIndices(context);
     
-    // add tree to forest
-    forest->AddTree( dtree );
+  // create tree
+  DecisionTree * dtree = new DecisionTree(context);
+  dtree->SetNumberOfThreads(nThreads);
+  dtree->GrowTree();
     
-    // save source/target distributions of unweighted sub-samples via HistService
-    for (const HistDefs::Entry & entry : m_histDefs->GetEntries()) {
-      HistService::Instance().AddHist(TString::Format("source_%s_%d", entry.Name().c_str(), itree).Data(), /*entry.Nbins()*/ 50, entry.Xmin(), entry.Xmax());
-      HistService::Instance().AddHist(TString::Format("target_%s_%d", entry.Name().c_str(), itree).Data(), /*entry.Nbins()*/ 50, entry.Xmin(), entry.Xmax());
-    }
-    // source
-    m_log << Log::INFO << "Process() : Saving source distributions" << Log::endl();
-    long maxEvent = m_indicesSource->size();
-    for (long ievent = 0; ievent < maxEvent; ++ievent) {
-      long index = m_indicesSource->at(ievent);
-      m_source->GetEntry( index );
-      for (const HistDefs::Entry & entry : m_histDefs->GetEntries()) {
-	HistService::Instance().GetHist( TString::Format("source_%s_%d", entry.Name().c_str(), itree).Data() )->Fill(entry.GetVariable()->Value());
-      }
+  // save source/target distributions of unweighted sub-samples in the context (passed to HistService once all trees are grown)
+  int itree = context.TreeIndex();
+  std::vector<TH1F *> histsSource;
+  std::vector<TH1F *> histsTarget;
+  for (const HistDefs::Entry & entry : m_histDefs->GetEntries()) {
+    histsSource.push_back( context.AddHist(TString::Format("source_%s_%d", entry.Name().c_str(), itree).Data(), /*entry.Nbins()*/ 50, entry.Xmin(), entry.Xmax()) );
+    histsTarget.push_back( context.AddHist(TString::Format("target_%s_%d", entry.Name().c_str(), itree).Data(), /*entry.Nbins()*/ 50, entry.Xmin(), entry.Xmax()) );
+  }
+  // source
+  {
+    std::lock_guard<std::mutex> lock(m_logMutex);
+    m_log << Log::INFO << "GrowTree() : Saving source distributions" << Log::endl();
+  }
+  FillHists(histsSource, m_cacheSource, context.IndicesSource(), context.MultiplicitySource());
+  // target
+  {
+    std::lock_guard<std::mutex> lock(m_logMutex);
+    m_log << Log::INFO << "GrowTree() : Saving target distributions" << Log::endl();
+  }
+  FillHists(histsTarget, m_cacheTarget, context.IndicesTarget(), context.MultiplicityTarget());
+
+  return dtree;
+
+}
+
+
+void RandomForest::FillHists(const std::vector<TH1F *> & hists, const EventCache * cache, const std::vector<long> & indices, const std::vector<unsigned char> & multiplicities) const
+{
+
+  // sub-sample given by multiplicities of all events (Poisson bootstrap)
+  if ( ! multiplicities.empty() ) {
+    for (unsigned long index = 0; index < multiplicities.size(); ++index) {
+      if ( multiplicities[index] == 0 ) continue;
+      for (unsigned int ivar = 0; ivar < hists.size(); ++ivar) hists[ivar]->Fill(cache->Value(ivar, index), multiplicities[index]);
     }
-    // target
-    m_log << Log::INFO << "Process() : Saving target distributions" << Log::endl();
-    maxEvent = m_indicesTarget->size();
-    for (long ievent = 0; ievent < maxEvent; ++ievent) {
-      long index = m_indicesTarget->at(ievent);
-      m_target->GetEntry( index );
-      for (const HistDefs::Entry & entry : m_histDefs->GetEntries()) {
-	HistService::Instance().GetHist( TString::Format("target_%s_%d", entry.Name().c_str(), itree).Data() )->Fill(entry.GetVariable()->Value());
-      }
+  }
+
+  // sub-sample given by event indices
+  else {
+    for (long index : indices) {
+      for (unsigned int ivar = 0; ivar < hists.size(); ++ivar) hists[ivar]->Fill(cache->Value(ivar, index));
     }
+  }
 
+  // add up the histograms of all event shards (bin contents and squared errors, including underflow and overflow, and
+  // number of entries)
+  Communicator & communicator = Communicator::Instance();
+  if ( communicator.NumberOfShards() <= 1 ) return;
+  std::vector<double> sums;
+  for (const TH1F * hist : hists) {
+    sums.push_back(hist->GetEntries());
+    for (int bin = 0; bin <= hist->GetNbinsX() + 1; ++bin) {
+      sums.push_back(hist->GetBinContent(bin));
+      sums.push_back(hist->GetBinError(bin)*hist->GetBinError(bin));
+    }
   }
-  
-  // add forest to internal vector
-  m_forests.clear();
-  m_forests.push_back( forest );
-  
+  communicator.AllReduceShards(sums.data(), sums.size());
+  unsigned long i = 0;
+  for (TH1F * hist : hists) {
+    double entries = sums[i++];
+    for (int bin = 0; bin <= hist->GetNbinsX() + 1; ++bin) {
+      hist->SetBinContent(bin, sums[i++]);
+      hist->SetBinError(bin, std::sqrt(sums[i++]));
+    }
+    hist->SetEntries(entries);
+  }
+
 }
 
 
@@ -144,57 +197,18 @@ void RandomForest::Write(std::ofstream & outfile) {
   const std::vector<const DecisionTree *> & decisionTrees = m_forests.at(0)->GetTrees();
 
   // write trees to file
-  float norm = GetNormalization();
-  for (const DecisionTree * dtree : decisionTrees) {
-    dtree->Write( outfile, norm );
+  float norm = Normalization();
+  for (unsigned int itree = 0; itree < decisionTrees.size(); ++itree) {
+    decisionTrees[itree]->Write( outfile, itree, norm );
   }
 
 }
 
 
-void RandomForest::GetWeight(float & weight, float & error) const
+void RandomForest::GetWeights(const float * features, long nEvents, float * weights, float * errors) const
 {
 
-  // reset weight/error
-  weight = 0;
-  error  = 0;
-  
-  // get total number of trees
-  static int nTreeTotal = 0;
-  if (nTreeTotal == 0) {
-    for (const Forest * forest : m_forests) {
-      nTreeTotal += forest->GetTrees().size();
-    }
-  }
-  
-  // declare vector to hold error
-  static std::vector<float> error_vec( nTreeTotal );
-  
-  // loop over forests
-  int iTree = 0;
-  for (const Forest * forest : m_forests) {
-
-    // loop over trees
-    for (const DecisionTree * tree : forest->GetTrees()) {     
-      float w = tree->GetWeight();
-      weight += w;
-      error_vec.at( iTree ) = w;
-    }
+  AverageTrees(m_forests, features, nEvents, weights, errors);
 
-    // increment tree counter
-    ++iTree;
-    
-  }
-  
-  // finalise weight
-  weight /= static_cast<float>( nTreeTotal );
-
-  // finalise error
-  for (float e : error_vec) {
-    error += pow(e - weight, 2);
-  }
-  if ( nTreeTotal > 1) error = sqrt( error/(nTreeTotal - 1) );
-  else error = sqrt( error/nTreeTotal );
-  
 }
 
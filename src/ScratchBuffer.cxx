@@ -0,0 +1,151 @@
+// local includes
+#include "ScratchBuffer.h"
+#include "Config.h"
+
+// stl includes
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+
+// system includes
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+ScratchBuffer::ScratchBuffer() :
+  m_data(0),
+  m_size(0),
+  m_fd(-1),
+  m_log("ScratchBuffer")
+{
+
+  // set log level
+  std::string str_level;
+  Config::Instance().getif<std::string>("PrintLevel", str_level);
+  if (str_level.length() > 0) {
+    Log::LEVEL level = Log::StringToLEVEL(str_level);
+    m_log.SetLevel(level);
+  }
+
+}
+
+
+ScratchBuffer::~ScratchBuffer()
+{
+
+  Free();
+
+}
+
+
+void ScratchBuffer::Allocate(unsigned long size, const std::string & directory)
+{
+
+  // discard previous contents
+  Free();
+  if ( size == 0 ) return;
+
+  // in memory (anonymous pages are zero-initialised)
+  if ( directory.empty() ) {
+    void * address = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( address == MAP_FAILED ) {
+      m_log << Log::ERROR << "Allocate() : Couldn't allocate " << size << " bytes (" << std::strerror(errno) << ")" << Log::endl();
+      throw(0);
+    }
+    m_data = address;
+    m_size = size;
+    return;
+  }
+
+  // create scratch file (removed right away, so it disappears with the buffer, also if the job crashes)
+  std::string name = directory + "/MLReweighting_XXXXXX";
+  std::vector<char> path(name.begin(), name.end());
+  path.push_back('\0');
+  int fd = mkstemp(path.data());
+  if ( fd < 0 ) {
+    m_log << Log::ERROR << "Allocate() : Couldn't create scratch file in " << directory << " (" << std::strerror(errno) << ")" << Log::endl();
+    throw(0);
+  }
+  unlink(path.data());
+  if ( ftruncate(fd, size) != 0 ) {
+    m_log << Log::ERROR << "Allocate() : Couldn't resize scratch file to " << size << " bytes (" << std::strerror(errno) << ")" << Log::endl();
+    close(fd);
+    throw(0);
+  }
+
+  // map file
+  void * address = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if ( address == MAP_FAILED ) {
+    m_log << Log::ERROR << "Allocate() : Couldn't map scratch file of " << size << " bytes (" << std::strerror(errno) << ")" << Log::endl();
+    close(fd);
+    throw(0);
+  }
+  m_data = address;
+  m_size = size;
+  m_fd   = fd;
+  m_log << Log::DEBUG << "Allocate() : Mapped scratch file of " << size << " bytes in " << directory << Log::endl();
+
+}
+
+
+void ScratchBuffer::Free()
+{
+
+  if ( m_data ) munmap(m_data, m_size);
+  if ( m_fd >= 0 ) close(m_fd);
+  m_data = 0;
+  m_size = 0;
+  m_fd   = -1;
+
+}
+
+
+void ScratchBuffer::Release(unsigned long offset, unsigned long size) const
+{
+
+  // release all pages touching the range (this is safe also if the rest of a page is still in use, since the pages of a
+  // shared file mapping are written back and read again from the file when accessed)
+  if ( m_fd < 0 || size == 0 ) return;
+  unsigned long pageSize = sysconf(_SC_PAGESIZE);
+  unsigned long first = offset/pageSize*pageSize;
+  unsigned long last  = std::min((offset + size + pageSize - 1)/pageSize*pageSize, m_size);
+  if ( last <= first ) return;
+
+  // drop from the process (modified pages stay in the page cache), and start writing back and dropping the pages from
+  // the page cache (without waiting for the disk, pages still being written are dropped the next time)
+  char * address = static_cast<char *>(m_data) + first;
+  madvise(address, last - first, MADV_DONTNEED);
+  posix_fadvise(m_fd, first, last - first, POSIX_FADV_DONTNEED);
+
+}
+
+
+std::string ScratchBuffer::Directory()
+{
+
+  int memoryBudget = 0;
+  Config::Instance().getif<int>("MemoryBudget", memoryBudget);
+  if ( memoryBudget <= 0 ) return "";
+
+  std::string directory = "/tmp";
+  Config::Instance().getif<std::string>("ScratchDirectory", directory);
+  return directory;
+
+}
+
+
+long ScratchBuffer::ChunkSize(long nEvents, unsigned long bytesPerEvent)
+{
+
+  int memoryBudget = 0;
+  Config::Instance().getif<int>("MemoryBudget", memoryBudget);
+  if ( memoryBudget <= 0 || bytesPerEvent == 0 ) return std::max(nEvents, 1L);
+
+  // at least a few pages per chunk
+  long chunkSize = (static_cast<unsigned long>(memoryBudget) << 20)/bytesPerEvent;
+  return std::max(std::min(chunkSize, nEvents), 4096L);
+
+}
@@ -39,6 +39,10 @@ Store::Store(const Store & other)
 Store & Store::operator=(const Store & other)
 {
 
+  if ( this == &other ) return *this;
+
+  flush();
+
   std::map<std::string,FieldBase*>::const_iterator it    = other.m_data.begin();
   std::map<std::string,FieldBase*>::const_iterator itEnd = other.m_data.end();
 
@@ -2,19 +2,25 @@
 #include "Variables.h"
 #include "Variable.h"
 #include "Event.h"
+#include "Log.h"
+#include "Schema.h"
 
 
-// preprocessor macro to add variables
-#define VARIABLE(name,type)						\
-  class name : public Variable {					\
-  public:								\
-  name(const std::string & vname) : Variable(vname) {}			\
-  float Value() const {							\
-    static type & value = Event::Instance().get<type>(m_name);	\
-    return static_cast<float>(value);					\
-  }									\
-  };									\
-  Variables::Get().push_back( new name(#name) );
+namespace {
+
+  // addresses of the Event buffers of the variables, set by Variables::Connect()
+  struct Sources {
+    #define VARIABLE(name, type) const type * name = 0;
+    #include "VARIABLES"
+    #undef VARIABLE
+  };
+  Sources sources;
+  bool connected = false;
+
+  // values of the current event (position = index of the variable)
+  std::vector<float> buffer;
+
+}
 
 
 
@@ -48,12 +54,61 @@ const Variable * Variables::Get(const std::string & name)
 }
 
 
+void Variables::Connect()
+{
+
+  // get addresses of the Event buffers (they don't change when other trees are connected)
+  Event & event = Event::Instance();
+  #define VARIABLE(name, type) sources.name = &event.get<type>(#name);
+  #include "VARIABLES"
+  #undef VARIABLE
+  buffer.resize(Schema::NVARIABLES);
+  connected = true;
+
+}
+
+
+void Variables::GetValues(float * values)
+{
+
+  // check that the Event buffers are known
+  if ( ! connected ) {
+    Log log("Variables");
+    log << Log::ERROR << "GetValues() : Variables are not connected to a TTree (see Event::ConnectAllVariables())" << Log::endl();
+    throw(0);
+  }
+
+  // convert values
+  #define VARIABLE(name, type) values[Schema::name] = static_cast<float>(*sources.name);
+  #include "VARIABLES"
+  #undef VARIABLE
+
+}
+
+
+void Variables::Read()
+{
+
+  GetValues(buffer.data());
+
+}
+
+
+const float * Variables::Values()
+{
+
+  return buffer.data();
+
+}
+
 
 void Variables::Initialize()
 {
 
   if ( Variables::Get().size() == 0 ) {
-    #include "VARIABLES"
+    for (const Schema::Entry & entry : Schema::TABLE) {
+      Variables::Get().push_back( new Variable(entry.name, entry.index) );
+    }
   }  
 
 }
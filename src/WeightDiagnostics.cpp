@@ -103,6 +103,9 @@ int main(int argc, char * argv[]) {
   log << Log::INFO << "Looping over events (" << source->GetName() << ") : "  << maxEvent << Log::endl();
   std::clock_t start = std::clock();
 
+  // buffer for the variables of each event
+  std::vector<float> features(Variables::Get().size());
+
   // Loop over ree entries
   for (long ievent = 0; ievent < maxEvent; ++ievent) {
 
@@ -116,6 +119,7 @@ int main(int argc, char * argv[]) {
     
     // get event
     source->GetEntry( ievent );
+    Variables::GetValues(features.data());
 
     // weight diagnostics  
     for (int index = 0; index < nMaxTrees; ++index) {
@@ -123,7 +127,7 @@ int main(int argc, char * argv[]) {
 	const std::vector<const DecisionTree *> trees = forests.at(f)->GetTrees();
 	int nTrees = trees.size();
 	if (index >= nTrees) continue;
-	WeightDiagnostics->Fill(index, trees.at(index)->GetWeight());
+	WeightDiagnostics->Fill(index, trees.at(index)->GetWeight(features.data()));
       }
     }
     